@@ -0,0 +1,391 @@
+#include "sound_seg.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Batch WAV ingest and export.
+//
+// Ingest: worker threads read whole files and parse them in memory; the
+// calling thread builds the tracks (the page cache is single threaded).
+// Export: the calling thread flattens tracks; worker threads write files.
+// In both directions the bytes held between stages are bounded, so a slow
+// stage blocks the faster one instead of growing memory.
+
+#define BATCH_DEFAULT_INFLIGHT (64u * 1024u * 1024u)
+#define BATCH_MAX_THREADS 64
+
+// Work item passed between pipeline stages
+struct batch_job {
+    size_t index;
+    void* data;                  // File contents (ingest) or samples (export)
+    size_t bytes;                // Size charged against the in-flight budget
+    const int16_t* samples;
+    size_t length;
+    struct batch_job* next;
+};
+
+struct batch_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;         // Broadcast on every state change
+    pthread_t threads[BATCH_MAX_THREADS];
+    size_t num_threads;
+    struct batch_job* jobs;      // One per file, indexed like `filenames`
+    const char** filenames;
+    struct wav_batch_result* results;
+    size_t count;
+    size_t next;                 // Next file a reader claims (ingest)
+    size_t inflight;             // Bytes held between stages
+    size_t limit;
+    struct batch_job* head;      // FIFO of jobs for the next stage
+    struct batch_job* tail;
+    bool producing;              // Caller still queueing jobs (export)
+};
+
+static void set_error(struct wav_batch_result* result, const char* fmt, const char* detail) {
+    result->ok = false;
+    snprintf(result->error, sizeof(result->error), fmt, detail);
+}
+
+static void queue_push(struct batch_pool* pool, struct batch_job* job) {
+    job->next = NULL;
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pthread_cond_broadcast(&pool->cond);
+}
+
+static struct batch_job* queue_pop(struct batch_pool* pool) {
+    struct batch_job* job = pool->head;
+    if (job) {
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+    }
+    return job;
+}
+
+// Block until `bytes` fit in the budget. A job larger than the whole budget
+// is admitted once nothing else is in flight so it cannot deadlock.
+static void reserve(struct batch_pool* pool, size_t bytes) {
+    while (pool->inflight > 0 && pool->inflight + bytes > pool->limit) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pool->inflight += bytes;
+}
+
+static void unreserve(struct batch_pool* pool, size_t bytes) {
+    pool->inflight -= bytes;
+    pthread_cond_broadcast(&pool->cond);
+}
+
+static bool read_file(int fd, void* data, size_t bytes) {
+    char* p = data;
+    off_t offset = 0;
+    while (bytes > 0) {
+        ssize_t n = pread(fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        bytes -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// In-memory equivalent of wav_load's chunk walk, including RF64/BW64
+static bool parse_wav(const uint8_t* data, size_t size, struct batch_job* job,
+                      struct wav_batch_result* result) {
+    bool rf64 = size >= 4 && (memcmp(data, "RF64", 4) == 0 || memcmp(data, "BW64", 4) == 0);
+    if (size < 12 || (memcmp(data, "RIFF", 4) != 0 && !rf64) ||
+        memcmp(data + 8, "WAVE", 4) != 0) {
+        set_error(result, "%s: invalid RIFF/WAVE header", "wav_load_batch");
+        return false;
+    }
+
+    bool found_fmt = false;
+    uint64_t ds64_data_size = UINT64_MAX;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        uint64_t chunk_size = read_u32(data + pos + 4);
+        const uint8_t* body = data + pos + 8;
+        size_t avail = size - pos - 8;
+
+        if (rf64 && memcmp(data + pos, "ds64", 4) == 0 && chunk_size >= 28 && avail >= 28) {
+            ds64_data_size = read_u64(body + 8);
+        } else if (memcmp(data + pos, "fmt ", 4) == 0) {
+            found_fmt = true;
+        } else if (memcmp(data + pos, "data", 4) == 0) {
+            if (!found_fmt) {
+                set_error(result, "%s: data chunk before fmt chunk", "wav_load_batch");
+                return false;
+            }
+            if (rf64 && chunk_size == 0xFFFFFFFFu) {
+                chunk_size = ds64_data_size;
+            }
+            if (chunk_size > avail) {
+                set_error(result, "%s: truncated data chunk", "wav_load_batch");
+                return false;
+            }
+            job->samples = (const int16_t*)body;
+            job->length = chunk_size / sizeof(int16_t);
+            return true;
+        }
+
+        // Chunks are padded to an even size
+        chunk_size += chunk_size & 1;
+        if (chunk_size > avail) break;
+        pos += 8 + (size_t)chunk_size;
+    }
+
+    set_error(result, "%s: no data chunk", "wav_load_batch");
+    return false;
+}
+
+// Read stage: load and parse one file at a time until none are left
+static void* ingest_worker(void* arg) {
+    struct batch_pool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->count) {
+        struct batch_job* job = &pool->jobs[pool->next++];
+        struct wav_batch_result* result = &pool->results[job->index];
+        pthread_mutex_unlock(&pool->lock);
+
+        int fd = open(pool->filenames[job->index], O_RDONLY);
+        struct stat st;
+        bool ok = fd >= 0 && fstat(fd, &st) == 0;
+        if (!ok) {
+            set_error(result, "cannot open file: %s", strerror(errno));
+        }
+
+        if (ok) {
+            pthread_mutex_lock(&pool->lock);
+            reserve(pool, (size_t)st.st_size);
+            pthread_mutex_unlock(&pool->lock);
+
+            job->bytes = (size_t)st.st_size;
+            job->data = malloc(job->bytes ? job->bytes : 1);
+            if (!job->data) {
+                set_error(result, "%s: out of memory", "wav_load_batch");
+                ok = false;
+            } else if (!read_file(fd, job->data, job->bytes)) {
+                set_error(result, "read failed: %s", strerror(errno));
+                ok = false;
+            } else {
+                ok = parse_wav(job->data, job->bytes, job, result);
+            }
+        }
+        if (fd >= 0) close(fd);
+
+        // Failed jobs are handed on too, so the caller sees every file once
+        pthread_mutex_lock(&pool->lock);
+        if (!ok) job->samples = NULL;
+        queue_push(pool, job);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Write stage: save flattened tracks until the caller stops producing
+static void* export_worker(void* arg) {
+    struct batch_pool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        struct batch_job* job = queue_pop(pool);
+        if (!job) {
+            if (!pool->producing) break;
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        struct wav_batch_result* result = &pool->results[job->index];
+        if (!wav_save(pool->filenames[job->index], job->data, job->length)) {
+            set_error(result, "cannot write file: %s", pool->filenames[job->index]);
+        }
+        free(job->data);
+        job->data = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        unreserve(pool, job->bytes);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static bool pool_init(struct batch_pool* pool, const char** filenames, size_t count,
+                      const struct wav_batch_options* options,
+                      struct wav_batch_result* results) {
+    memset(pool, 0, sizeof(*pool));
+    pool->filenames = filenames;
+    pool->results = results;
+    pool->count = count;
+    pool->limit = options && options->max_inflight_bytes ?
+                  options->max_inflight_bytes : BATCH_DEFAULT_INFLIGHT;
+
+    size_t threads = options ? options->threads : 0;
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    if (threads > count) threads = count;
+    pool->num_threads = threads;
+
+    pool->jobs = calloc(count, sizeof(struct batch_job));
+    if (!pool->jobs) return false;
+
+    for (size_t i = 0; i < count; i++) {
+        pool->jobs[i].index = i;
+        results[i].track = NULL;
+        results[i].ok = true;
+        results[i].error[0] = '\0';
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    return true;
+}
+
+static size_t pool_start(struct batch_pool* pool, void* (*worker)(void*)) {
+    size_t started = 0;
+    while (started < pool->num_threads &&
+           pthread_create(&pool->threads[started], NULL, worker, pool) == 0) {
+        started++;
+    }
+    return started;
+}
+
+static bool pool_finish(struct batch_pool* pool, size_t started) {
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->jobs);
+
+    bool all_ok = true;
+    for (size_t i = 0; i < pool->count; i++) {
+        all_ok = all_ok && pool->results[i].ok;
+    }
+    return all_ok;
+}
+
+bool wav_load_batch(const char** filenames, size_t count,
+                    const struct wav_batch_options* options,
+                    struct wav_batch_result* results) {
+    if (!filenames || !results) return false;
+    if (count == 0) return true;
+
+    struct batch_pool pool;
+    if (!pool_init(&pool, filenames, count, options, results)) return false;
+
+    size_t started = pool_start(&pool, ingest_worker);
+    if (started == 0) {
+        // No threads available: run the read stage inline. Nothing drains
+        // the queue meanwhile, so the in-flight bound cannot apply.
+        pool.limit = SIZE_MAX;
+        ingest_worker(&pool);
+    }
+
+    // Construction stage runs here, in completion order
+    for (size_t done = 0; done < count; done++) {
+        pthread_mutex_lock(&pool.lock);
+        struct batch_job* job;
+        while (!(job = queue_pop(&pool))) {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        struct wav_batch_result* result = &results[job->index];
+        if (job->samples) {
+            result->track = tr_init();
+            if (!result->track ||
+                !tr_write(result->track, 0, job->length, job->samples)) {
+                tr_destroy(result->track);
+                result->track = NULL;
+                set_error(result, "%s: cannot build track", "wav_load_batch");
+            }
+        }
+        free(job->data);
+        job->data = NULL;
+
+        pthread_mutex_lock(&pool.lock);
+        unreserve(&pool, job->bytes);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    return pool_finish(&pool, started);
+}
+
+bool wav_save_batch(const char** filenames, struct sound_seg** tracks, size_t count,
+                    const struct wav_batch_options* options,
+                    struct wav_batch_result* results) {
+    if (!filenames || !tracks || !results) return false;
+    if (count == 0) return true;
+
+    struct batch_pool pool;
+    if (!pool_init(&pool, filenames, count, options, results)) return false;
+    pool.producing = true;
+
+    size_t started = pool_start(&pool, export_worker);
+
+    // Flatten stage runs here, since tr_read goes through the page cache
+    for (size_t i = 0; i < count; i++) {
+        struct batch_job* job = &pool.jobs[i];
+        job->length = tr_length(tracks[i]);
+        job->bytes = job->length * sizeof(int16_t);
+
+        pthread_mutex_lock(&pool.lock);
+        reserve(&pool, job->bytes);
+        pthread_mutex_unlock(&pool.lock);
+
+        job->data = malloc(job->bytes ? job->bytes : 1);
+        if (!tracks[i] || !job->data || !tr_read(tracks[i], 0, job->length, job->data)) {
+            set_error(&results[i], "%s: cannot read track", "wav_save_batch");
+            free(job->data);
+            job->data = NULL;
+            pthread_mutex_lock(&pool.lock);
+            unreserve(&pool, job->bytes);
+            pthread_mutex_unlock(&pool.lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        queue_push(&pool, job);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (started == 0) {
+            // No threads available: drain the write stage inline
+            pool.producing = false;
+            export_worker(&pool);
+            pool.producing = true;
+        }
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.producing = false;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    return pool_finish(&pool, started);
+}
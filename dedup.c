@@ -0,0 +1,140 @@
+#include "page_cache.h"
+#include <string.h>
+
+// Content-addressed deduplication of fixed-size sample blocks. Registered
+// buffers are chained in a hash table keyed by a hash of their samples;
+// identical blocks written later reference the registered buffer instead
+// of allocating a copy. Writers copy-on-write while a block has other
+// users (see tr_write), and unregister it before modifying it in place.
+
+#define DEDUP_DEFAULT_BLOCK 8192
+
+static struct {
+    bool enabled;
+    size_t block;                    // Block size in samples
+    struct sample_buffer** buckets;
+    size_t num_buckets;              // Power of two
+    size_t count;                    // Registered blocks
+    size_t unique_bytes;             // Sample bytes of registered blocks
+    size_t bytes_in;                 // Bytes passed through dedup_acquire
+    size_t bytes_stored;             // Bytes of blocks that had to be stored
+    size_t hits;
+} dedup = { .block = DEDUP_DEFAULT_BLOCK };
+
+static uint64_t hash_samples(const int16_t* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    size_t bytes = length * sizeof(int16_t);
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ bytes;
+
+    while (bytes >= 8) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        h = (h ^ (k * 0xff51afd7ed558ccdULL)) * 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 29;
+        p += 8;
+        bytes -= 8;
+    }
+    while (bytes > 0) {
+        h = (h ^ *p++) * 0x100000001b3ULL;
+        bytes--;
+    }
+    return h ^ (h >> 32);
+}
+
+static bool table_grow(void) {
+    size_t num_buckets = dedup.num_buckets ? dedup.num_buckets * 2 : 1024;
+    struct sample_buffer** buckets = calloc(num_buckets, sizeof(*buckets));
+    if (!buckets) return false;
+
+    for (size_t i = 0; i < dedup.num_buckets; i++) {
+        struct sample_buffer* buf = dedup.buckets[i];
+        while (buf) {
+            struct sample_buffer* next = buf->dedup_next;
+            size_t slot = buf->dedup_hash & (num_buckets - 1);
+            buf->dedup_next = buckets[slot];
+            buckets[slot] = buf;
+            buf = next;
+        }
+    }
+
+    free(dedup.buckets);
+    dedup.buckets = buckets;
+    dedup.num_buckets = num_buckets;
+    return true;
+}
+
+size_t dedup_block_size(void) {
+    return dedup.enabled ? dedup.block : 0;
+}
+
+struct sample_buffer* dedup_acquire(const int16_t* data, size_t length,
+                                    struct memory_ledger* ledger) {
+    uint64_t hash = hash_samples(data, length);
+    dedup.bytes_in += length * sizeof(int16_t);
+
+    if (dedup.num_buckets > 0) {
+        struct sample_buffer* buf = dedup.buckets[hash & (dedup.num_buckets - 1)];
+        for (; buf; buf = buf->dedup_next) {
+            if (buf->dedup_hash != hash || buf->length != length) continue;
+
+            // Hashes only select candidates; the samples decide
+            int16_t* samples = buffer_data(buf);
+            if (samples && memcmp(samples, data, length * sizeof(int16_t)) == 0) {
+                dedup.hits++;
+                return buffer_retain(buf);
+            }
+        }
+    }
+
+    struct sample_buffer* buf = buffer_create(length, ledger);
+    if (!buf) return NULL;
+    memcpy(buf->data, data, length * sizeof(int16_t));
+    buf->length = length;
+    dedup.bytes_stored += length * sizeof(int16_t);
+
+    // Failing to grow only lengthens the chains; without any table the
+    // block is simply left unregistered
+    if (dedup.count >= dedup.num_buckets) table_grow();
+    if (dedup.num_buckets == 0) return buf;
+
+    size_t slot = hash & (dedup.num_buckets - 1);
+    buf->dedup = true;
+    buf->dedup_hash = hash;
+    buf->dedup_next = dedup.buckets[slot];
+    dedup.buckets[slot] = buf;
+    dedup.count++;
+    dedup.unique_bytes += length * sizeof(int16_t);
+    return buf;
+}
+
+void dedup_forget(struct sample_buffer* buf) {
+    if (!buf || !buf->dedup) return;
+
+    struct sample_buffer** link = &dedup.buckets[buf->dedup_hash & (dedup.num_buckets - 1)];
+    while (*link && *link != buf) {
+        link = &(*link)->dedup_next;
+    }
+    if (*link) {
+        *link = buf->dedup_next;
+        dedup.count--;
+        dedup.unique_bytes -= buf->length * sizeof(int16_t);
+    }
+    buf->dedup = false;
+    buf->dedup_next = NULL;
+}
+
+void tr_dedup_configure(bool enabled, size_t block_samples) {
+    dedup.enabled = enabled;
+    dedup.block = block_samples ? block_samples : DEDUP_DEFAULT_BLOCK;
+}
+
+void tr_dedup_stats(struct tr_dedup_stats* stats) {
+    if (!stats) return;
+
+    stats->unique_blocks = dedup.count;
+    stats->unique_bytes = dedup.unique_bytes;
+    stats->bytes_written = dedup.bytes_in;
+    stats->bytes_stored = dedup.bytes_stored;
+    stats->bytes_saved = dedup.bytes_in - dedup.bytes_stored;
+    stats->hits = dedup.hits;
+}
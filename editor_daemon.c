@@ -0,0 +1,431 @@
+#include "editor_daemon.h"
+#include "sound_seg.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Samples moved per tr_read/tr_write when streaming READ and WRITE payloads
+#define DAEMON_CHUNK_SAMPLES 65536
+#define DAEMON_MAX_PATH 4096
+
+// Resident tracks, addressed by their index
+struct daemon_state {
+    struct sound_seg** tracks;
+    size_t num_tracks;
+    size_t capacity;
+    bool shutdown;
+};
+
+// One client connection while a command is being processed
+struct daemon_conn {
+    FILE* in;
+    FILE* out;
+    uint64_t remaining;          // Unread payload bytes of the current command
+};
+
+// Consume `n` bytes of the current payload; fails past its end
+static bool take(struct daemon_conn* conn, void* dst, size_t n) {
+    if (n > conn->remaining) return false;
+    if (fread(dst, 1, n, conn->in) != n) return false;
+    conn->remaining -= n;
+    return true;
+}
+
+static bool take_u32(struct daemon_conn* conn, uint32_t* v) {
+    return take(conn, v, sizeof(*v));
+}
+
+static bool take_u64(struct daemon_conn* conn, uint64_t* v) {
+    return take(conn, v, sizeof(*v));
+}
+
+// Read the rest of the payload as a NUL-terminated path
+static bool take_path(struct daemon_conn* conn, char* path) {
+    if (conn->remaining == 0 || conn->remaining >= DAEMON_MAX_PATH) return false;
+    size_t n = (size_t)conn->remaining;
+    if (!take(conn, path, n)) return false;
+    path[n] = '\0';
+    return true;
+}
+
+static bool skip_payload(struct daemon_conn* conn) {
+    char scratch[4096];
+    while (conn->remaining > 0) {
+        size_t n = conn->remaining < sizeof(scratch) ? (size_t)conn->remaining : sizeof(scratch);
+        if (!take(conn, scratch, n)) return false;
+    }
+    return true;
+}
+
+static bool reply_header(struct daemon_conn* conn, int32_t status, uint64_t length) {
+    return fwrite(&status, sizeof(status), 1, conn->out) == 1 &&
+           fwrite(&length, sizeof(length), 1, conn->out) == 1;
+}
+
+static bool reply(struct daemon_conn* conn, int32_t status, const void* data, size_t length) {
+    return reply_header(conn, status, length) &&
+           (length == 0 || fwrite(data, 1, length, conn->out) == length);
+}
+
+static bool reply_error(struct daemon_conn* conn, int32_t status, const char* message) {
+    return reply(conn, status, message, strlen(message));
+}
+
+static struct sound_seg* lookup(struct daemon_state* state, uint32_t id) {
+    return id < state->num_tracks ? state->tracks[id] : NULL;
+}
+
+static bool add_track(struct daemon_state* state, struct sound_seg* track, uint32_t* id) {
+    if (state->num_tracks == state->capacity) {
+        size_t capacity = state->capacity ? state->capacity * 2 : 16;
+        struct sound_seg** grown = realloc(state->tracks, capacity * sizeof(*grown));
+        if (!grown) return false;
+        state->tracks = grown;
+        state->capacity = capacity;
+    }
+    *id = (uint32_t)state->num_tracks;
+    state->tracks[state->num_tracks++] = track;
+    return true;
+}
+
+static bool op_read(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    uint64_t pos, len;
+    if (!take_u32(conn, &id) || !take_u64(conn, &pos) || !take_u64(conn, &len)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "read: malformed payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) return reply_error(conn, EDITOR_NO_TRACK, "read: no such track");
+    if (pos + len > tr_length(track) || pos + len < pos) {
+        return reply_error(conn, EDITOR_FAILED, "read: range out of bounds");
+    }
+
+    // Stream the samples straight from the track into the reply
+    int16_t chunk[DAEMON_CHUNK_SAMPLES];
+    if (!reply_header(conn, EDITOR_OK, len * sizeof(int16_t))) return false;
+    while (len > 0) {
+        size_t n = len < DAEMON_CHUNK_SAMPLES ? (size_t)len : DAEMON_CHUNK_SAMPLES;
+        // The range was checked, so a failure here is a paging I/O error and
+        // the reply cannot be completed
+        if (!tr_read(track, (size_t)pos, n, chunk) ||
+            fwrite(chunk, sizeof(int16_t), n, conn->out) != n) {
+            return false;
+        }
+        pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool op_write(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    uint64_t pos, len;
+    if (!take_u32(conn, &id) || !take_u64(conn, &pos) || !take_u64(conn, &len) ||
+        conn->remaining != len * sizeof(int16_t)) {
+        return skip_payload(conn) &&
+               reply_error(conn, EDITOR_BAD_REQUEST, "write: malformed payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) {
+        return skip_payload(conn) && reply_error(conn, EDITOR_NO_TRACK, "write: no such track");
+    }
+
+    int16_t chunk[DAEMON_CHUNK_SAMPLES];
+    bool ok = true;
+    while (len > 0) {
+        size_t n = len < DAEMON_CHUNK_SAMPLES ? (size_t)len : DAEMON_CHUNK_SAMPLES;
+        if (!take(conn, chunk, n * sizeof(int16_t))) return false;
+        ok = ok && tr_write(track, (size_t)pos, n, chunk);
+        pos += n;
+        len -= n;
+    }
+    return ok ? reply(conn, EDITOR_OK, NULL, 0)
+              : reply_error(conn, EDITOR_FAILED, "write: tr_write failed");
+}
+
+static bool op_insert(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t dest_id, src_id;
+    uint64_t destpos, srcpos, len;
+    if (!take_u32(conn, &dest_id) || !take_u64(conn, &destpos) ||
+        !take_u32(conn, &src_id) || !take_u64(conn, &srcpos) || !take_u64(conn, &len)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "insert: malformed payload");
+    }
+
+    struct sound_seg* dest = lookup(state, dest_id);
+    struct sound_seg* src = lookup(state, src_id);
+    if (!dest || !src) return reply_error(conn, EDITOR_NO_TRACK, "insert: no such track");
+
+    return tr_insert(dest, (size_t)destpos, src, (size_t)srcpos, (size_t)len)
+        ? reply(conn, EDITOR_OK, NULL, 0)
+        : reply_error(conn, EDITOR_FAILED, "insert: tr_insert failed");
+}
+
+static bool op_delete(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    uint64_t pos, len;
+    if (!take_u32(conn, &id) || !take_u64(conn, &pos) || !take_u64(conn, &len)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "delete: malformed payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) return reply_error(conn, EDITOR_NO_TRACK, "delete: no such track");
+
+    return tr_delete_range(track, (size_t)pos, (size_t)len)
+        ? reply(conn, EDITOR_OK, NULL, 0)
+        : reply_error(conn, EDITOR_FAILED, "delete: tr_delete_range failed");
+}
+
+static bool op_identify(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t target_id, ad_id;
+    if (!take_u32(conn, &target_id) || !take_u32(conn, &ad_id)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "identify: malformed payload");
+    }
+
+    struct sound_seg* target = lookup(state, target_id);
+    struct sound_seg* ad = lookup(state, ad_id);
+    if (!target || !ad) return reply_error(conn, EDITOR_NO_TRACK, "identify: no such track");
+
+    char* result = tr_identify(target, ad);
+    if (!result) return reply_error(conn, EDITOR_FAILED, "identify: tr_identify failed");
+    bool ok = reply(conn, EDITOR_OK, result, strlen(result));
+    free(result);
+    return ok;
+}
+
+static bool op_resolve(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t n;
+    if (!take_u32(conn, &n) || conn->remaining != (uint64_t)n * sizeof(uint32_t)) {
+        return skip_payload(conn) &&
+               reply_error(conn, EDITOR_BAD_REQUEST, "resolve: malformed payload");
+    }
+
+    struct sound_seg** tracks = malloc((n ? n : 1) * sizeof(*tracks));
+    if (!tracks) {
+        return skip_payload(conn) && reply_error(conn, EDITOR_FAILED, "resolve: out of memory");
+    }
+
+    bool found = true;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t id;
+        if (!take_u32(conn, &id)) {
+            free(tracks);
+            return false;
+        }
+        tracks[i] = lookup(state, id);
+        found = found && tracks[i];
+    }
+
+    if (found) tr_resolve(tracks, n);
+    free(tracks);
+    return found ? reply(conn, EDITOR_OK, NULL, 0)
+                 : reply_error(conn, EDITOR_NO_TRACK, "resolve: no such track");
+}
+
+static bool op_load(struct daemon_state* state, struct daemon_conn* conn) {
+    char path[DAEMON_MAX_PATH];
+    if (!take_path(conn, path)) {
+        return skip_payload(conn) && reply_error(conn, EDITOR_BAD_REQUEST, "load: bad path");
+    }
+
+    struct sound_seg* track = tr_init();
+    uint32_t id;
+    if (!track || !tr_load_wav(track, path) || !add_track(state, track, &id)) {
+        tr_destroy(track);
+        return reply_error(conn, EDITOR_FAILED, "load: cannot load file");
+    }
+    return reply(conn, EDITOR_OK, &id, sizeof(id));
+}
+
+static bool op_save(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    char path[DAEMON_MAX_PATH];
+    if (!take_u32(conn, &id) || !take_path(conn, path)) {
+        return skip_payload(conn) && reply_error(conn, EDITOR_BAD_REQUEST, "save: bad payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) return reply_error(conn, EDITOR_NO_TRACK, "save: no such track");
+
+    return tr_save_wav(track, path) ? reply(conn, EDITOR_OK, NULL, 0)
+                                    : reply_error(conn, EDITOR_FAILED, "save: cannot write file");
+}
+
+static bool op_init(struct daemon_state* state, struct daemon_conn* conn) {
+    struct sound_seg* track = tr_init();
+    uint32_t id;
+    if (!track || !add_track(state, track, &id)) {
+        tr_destroy(track);
+        return reply_error(conn, EDITOR_FAILED, "init: out of memory");
+    }
+    return reply(conn, EDITOR_OK, &id, sizeof(id));
+}
+
+static bool op_length(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    if (!take_u32(conn, &id)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "length: malformed payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) return reply_error(conn, EDITOR_NO_TRACK, "length: no such track");
+
+    uint64_t length = tr_length(track);
+    return reply(conn, EDITOR_OK, &length, sizeof(length));
+}
+
+static bool op_destroy(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t id;
+    if (!take_u32(conn, &id)) {
+        return reply_error(conn, EDITOR_BAD_REQUEST, "destroy: malformed payload");
+    }
+
+    struct sound_seg* track = lookup(state, id);
+    if (!track) return reply_error(conn, EDITOR_NO_TRACK, "destroy: no such track");
+
+    // Ids are never reused, so stale ids from other clients fail cleanly
+    tr_destroy(track);
+    state->tracks[id] = NULL;
+    return reply(conn, EDITOR_OK, NULL, 0);
+}
+
+// Run one command; returns false if the connection is no longer usable
+static bool run_command(struct daemon_state* state, struct daemon_conn* conn) {
+    uint32_t op;
+    if (fread(&op, sizeof(op), 1, conn->in) != 1 ||
+        fread(&conn->remaining, sizeof(conn->remaining), 1, conn->in) != 1) {
+        return false;
+    }
+
+    bool ok;
+    switch (op) {
+        case EDITOR_OP_LOAD:     ok = op_load(state, conn); break;
+        case EDITOR_OP_READ:     ok = op_read(state, conn); break;
+        case EDITOR_OP_WRITE:    ok = op_write(state, conn); break;
+        case EDITOR_OP_INSERT:   ok = op_insert(state, conn); break;
+        case EDITOR_OP_DELETE:   ok = op_delete(state, conn); break;
+        case EDITOR_OP_IDENTIFY: ok = op_identify(state, conn); break;
+        case EDITOR_OP_RESOLVE:  ok = op_resolve(state, conn); break;
+        case EDITOR_OP_SAVE:     ok = op_save(state, conn); break;
+        case EDITOR_OP_INIT:     ok = op_init(state, conn); break;
+        case EDITOR_OP_LENGTH:   ok = op_length(state, conn); break;
+        case EDITOR_OP_DESTROY:  ok = op_destroy(state, conn); break;
+        case EDITOR_OP_SHUTDOWN:
+            state->shutdown = true;
+            ok = reply(conn, EDITOR_OK, NULL, 0);
+            break;
+        default:
+            ok = reply_error(conn, EDITOR_BAD_REQUEST, "unknown op");
+            break;
+    }
+
+    // Ignore trailing payload bytes so the next command stays in sync
+    return ok && skip_payload(conn);
+}
+
+// Serve one client until it disconnects or asks for shutdown
+static void serve(struct daemon_state* state, int fd) {
+    int out_fd = dup(fd);
+    struct daemon_conn conn = {
+        .in = fdopen(fd, "rb"),
+        .out = out_fd >= 0 ? fdopen(out_fd, "wb") : NULL
+    };
+    if (!conn.in || !conn.out) {
+        if (conn.in) fclose(conn.in); else close(fd);
+        if (conn.out) fclose(conn.out); else if (out_fd >= 0) close(out_fd);
+        return;
+    }
+
+    while (!state->shutdown) {
+        uint32_t count;
+        if (fread(&count, sizeof(count), 1, conn.in) != 1) break;
+
+        bool ok = true;
+        for (uint32_t i = 0; ok && i < count; i++) {
+            ok = run_command(state, &conn);
+        }
+        // Replies stream out as the stdio buffer fills; flush the tail so
+        // the client sees the whole request answered
+        if (fflush(conn.out) != 0 || !ok) break;
+    }
+
+    fclose(conn.in);
+    fclose(conn.out);
+}
+
+// Remove a socket left behind by an earlier daemon. Anything else at the
+// path is not ours to delete, so binding fails instead.
+static bool clear_stale_socket(const char* socket_path) {
+    struct stat st;
+    if (lstat(socket_path, &st) != 0) return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode)) {
+        printf("daemon: %s exists and is not a socket\n", socket_path);
+        return false;
+    }
+    return unlink(socket_path) == 0 || errno == ENOENT;
+}
+
+int editor_daemon_run(const char* socket_path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("daemon: Invalid socket path\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // A client disconnecting mid-reply must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        printf("daemon: Cannot create socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (!clear_stale_socket(socket_path)) {
+        close(listen_fd);
+        return 1;
+    }
+    // Remember which file we created so shutdown never removes a socket
+    // another daemon bound at the same path in the meantime
+    struct stat bound;
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        lstat(socket_path, &bound) != 0 ||
+        listen(listen_fd, 16) != 0) {
+        printf("daemon: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+    printf("daemon: Listening on %s\n", socket_path);
+
+    // Clients are served one at a time; tracks persist across connections
+    struct daemon_state state = {0};
+    while (!state.shutdown) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            printf("daemon: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        serve(&state, fd);
+    }
+
+    close(listen_fd);
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode) &&
+        st.st_dev == bound.st_dev && st.st_ino == bound.st_ino) {
+        unlink(socket_path);
+    }
+
+    for (size_t i = 0; i < state.num_tracks; i++) {
+        tr_destroy(state.tracks[i]);
+    }
+    free(state.tracks);
+    return 0;
+}
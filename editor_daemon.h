@@ -0,0 +1,60 @@
+#ifndef EDITOR_DAEMON_H
+#define EDITOR_DAEMON_H
+
+#include <stdint.h>
+
+// Long-running editor daemon. Tracks stay resident between requests and
+// clients talk to it over a UNIX domain stream socket.
+//
+// Wire format (native byte order, fields packed, no padding):
+//
+//   request  := uint32 command_count, command * command_count
+//   command  := uint32 op, uint64 payload_length, payload
+//   reply    := int32 status, uint64 payload_length, payload
+//
+// Each command gets exactly one reply, written as soon as it completes and
+// flushed at the end of the request, so clients may pipeline requests.
+// A failed command replies with a non-zero status and an error message;
+// the rest of the request still runs.
+//
+// Payloads (track ids are uint32, positions and lengths uint64 samples):
+//
+//   LOAD      path bytes                      -> uint32 id
+//   READ      id, pos, len                    -> len int16 samples
+//   WRITE     id, pos, len, len int16 samples -> (empty)
+//   INSERT    dest, destpos, src, srcpos, len -> (empty)
+//   DELETE    id, pos, len                    -> (empty)
+//   IDENTIFY  target id, ad id                -> tr_identify text
+//   RESOLVE   uint32 n, n ids                 -> (empty)
+//   SAVE      id, path bytes                  -> (empty)
+//   INIT      (empty)                         -> uint32 id
+//   LENGTH    id                              -> uint64 length
+//   DESTROY   id                              -> (empty)
+//   SHUTDOWN  (empty)                         -> (empty), daemon exits
+
+enum editor_op {
+    EDITOR_OP_LOAD = 1,
+    EDITOR_OP_READ = 2,
+    EDITOR_OP_WRITE = 3,
+    EDITOR_OP_INSERT = 4,
+    EDITOR_OP_DELETE = 5,
+    EDITOR_OP_IDENTIFY = 6,
+    EDITOR_OP_RESOLVE = 7,
+    EDITOR_OP_SAVE = 8,
+    EDITOR_OP_INIT = 9,
+    EDITOR_OP_LENGTH = 10,
+    EDITOR_OP_DESTROY = 11,
+    EDITOR_OP_SHUTDOWN = 12
+};
+
+enum editor_status {
+    EDITOR_OK = 0,
+    EDITOR_BAD_REQUEST = 1,          // Unknown op or malformed payload
+    EDITOR_NO_TRACK = 2,             // Track id not loaded
+    EDITOR_FAILED = 3                // The library call returned failure
+};
+
+// Serve clients on `socket_path` until SHUTDOWN; returns a process exit code
+int editor_daemon_run(const char* socket_path);
+
+#endif // EDITOR_DAEMON_H
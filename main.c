@@ -1,9 +1,19 @@
 #include "sound_seg.h"
+#include "editor_daemon.h"
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
 
-int main() {
+int main(int argc, char** argv) {
+    // Daemon mode: keep tracks resident and serve commands over a socket
+    if (argc == 3 && strcmp(argv[1], "--daemon") == 0) {
+        return editor_daemon_run(argv[2]);
+    }
+    if (argc != 1) {
+        printf("Usage: %s [--daemon SOCKET_PATH]\n", argv[0]);
+        return 1;
+    }
+
     // Initialize a new track
     struct sound_seg* track = tr_init();
     if (!track) {
@@ -13,7 +23,6 @@ int main() {
 
     const char* filename = "input.wav";
     // Load audio from WAV file
-    size_t length;
     printf("Attempting to load file: %s\n", filename);
     
     // First check if the file can be opened
@@ -25,23 +34,15 @@ int main() {
     }
     fclose(test);
     
-    int16_t* samples = wav_load(filename, &length);
-    if (!samples) {
+    // Stream samples into the track in bounded chunks
+    if (!tr_load_wav(track, filename)) {
         printf("Failed to load WAV file: %s\n", filename);
         printf("Make sure the file is a valid WAV file\n");
         tr_destroy(track);
         return 1;
     }
 
-    printf("Successfully loaded WAV file. Length: %zu samples\n", length);
-
-    // Write data to track
-    if (!tr_write(track, 0, length, samples)) {
-        printf("Failed to write samples to track\n");
-        free(samples);
-        tr_destroy(track);
-        return 1;
-    }
+    printf("Successfully loaded WAV file. Length: %zu samples\n", tr_length(track));
 
     // Display track length
     printf("Track length: %zu samples\n", tr_length(track));
@@ -57,7 +58,6 @@ int main() {
     }
 
     // Clean up resources
-    free(samples);
     tr_destroy(track);
     return 0;
 } 
\ No newline at end of file
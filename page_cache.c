@@ -0,0 +1,459 @@
+#include "page_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Free region of the spill file that can be reused by a later eviction
+struct spill_slot {
+    long long offset;
+    size_t capacity;             // In samples
+    struct spill_slot* next;
+};
+
+// Process-wide page cache state
+static struct {
+    int fd;                          // Spill file descriptor (-1 until needed)
+    size_t budget;                   // Resident byte budget (0 = unlimited)
+    size_t prefetch;                 // Readahead window in samples
+    size_t resident;                 // Resident sample bytes
+    size_t spilled;                  // Spill bytes held by live buffers
+    long long spill_end;             // End of the used part of the spill file
+    struct spill_slot* free_slots;   // Reusable spill regions
+    struct sample_buffer* lru_head;  // Most recently used
+    struct sample_buffer* lru_tail;  // Least recently used
+    size_t faults;
+    size_t prefetches;
+    size_t evictions;
+} pager = { .fd = -1 };
+
+// Process-wide allocation budget
+static struct {
+    size_t allocated;
+    size_t budget;               // 0 = unlimited
+    tr_budget_hook hook;
+    void* hook_data;
+} budget;
+
+struct memory_ledger* ledger_create(struct sound_seg* track) {
+    struct memory_ledger* ledger = calloc(1, sizeof(struct memory_ledger));
+    if (!ledger) return NULL;
+
+    ledger->track = track;
+    ledger->refs = 1;
+    return ledger;
+}
+
+void ledger_release(struct memory_ledger* ledger) {
+    if (ledger && --ledger->refs == 0) free(ledger);
+}
+
+static bool over_budget(const struct memory_ledger* ledger, size_t bytes) {
+    if (budget.budget && budget.allocated + bytes > budget.budget) return true;
+    return ledger && ledger->budget && ledger->allocated + bytes > ledger->budget;
+}
+
+// Reserve `bytes` against the global and track budgets. The hook is asked
+// to make room for as long as it reports success and actually frees memory.
+static bool charge(struct memory_ledger* ledger, size_t bytes) {
+    while (over_budget(ledger, bytes)) {
+        size_t before = budget.allocated + (ledger ? ledger->allocated : 0);
+        if (!budget.hook ||
+            !budget.hook(ledger ? ledger->track : NULL, bytes, budget.hook_data)) {
+            return false;
+        }
+        if (budget.allocated + (ledger ? ledger->allocated : 0) >= before &&
+            over_budget(ledger, bytes)) {
+            return false;
+        }
+    }
+
+    budget.allocated += bytes;
+    if (ledger) ledger->allocated += bytes;
+    return true;
+}
+
+static void uncharge(struct memory_ledger* ledger, size_t bytes) {
+    budget.allocated -= bytes;
+    if (ledger) ledger->allocated -= bytes;
+}
+
+static void lru_unlink(struct sample_buffer* buf) {
+    if (buf->lru_prev) {
+        buf->lru_prev->lru_next = buf->lru_next;
+    } else {
+        pager.lru_head = buf->lru_next;
+    }
+    if (buf->lru_next) {
+        buf->lru_next->lru_prev = buf->lru_prev;
+    } else {
+        pager.lru_tail = buf->lru_prev;
+    }
+    buf->lru_prev = NULL;
+    buf->lru_next = NULL;
+}
+
+static void lru_push_front(struct sample_buffer* buf) {
+    buf->lru_prev = NULL;
+    buf->lru_next = pager.lru_head;
+    if (pager.lru_head) {
+        pager.lru_head->lru_prev = buf;
+    } else {
+        pager.lru_tail = buf;
+    }
+    pager.lru_head = buf;
+}
+
+static bool spill_open(const char* path) {
+    char tmpl[4096];
+    int fd;
+    if (path) {
+        // Never reuse an existing file: the name is unlinked below, so a
+        // mistyped path must not destroy whatever already lives there
+        snprintf(tmpl, sizeof(tmpl), "%s", path);
+        fd = open(tmpl, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+        const char* dir = getenv("TMPDIR");
+        snprintf(tmpl, sizeof(tmpl), "%s/sound_seg_spill_XXXXXX",
+                 dir ? dir : "/tmp");
+        fd = mkstemp(tmpl);
+    }
+    if (fd < 0) {
+        printf("pager: Cannot open spill file: %s\n", strerror(errno));
+        return false;
+    }
+
+    // The spill file is private to this process and was created by the
+    // call above; drop its name right away so it disappears on exit
+    unlink(tmpl);
+
+    if (pager.fd >= 0) close(pager.fd);
+    pager.fd = fd;
+    pager.spill_end = 0;
+    return true;
+}
+
+static bool spill_io(bool write_mode, void* data, size_t bytes, long long offset) {
+    char* p = data;
+    while (bytes > 0) {
+        ssize_t n = write_mode ? pwrite(pager.fd, p, bytes, offset)
+                               : pread(pager.fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        bytes -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+static void slot_free(long long offset, size_t capacity) {
+    struct spill_slot* slot = malloc(sizeof(struct spill_slot));
+    if (!slot) return;  // The region is simply leaked inside the spill file
+    slot->offset = offset;
+    slot->capacity = capacity;
+    slot->next = pager.free_slots;
+    pager.free_slots = slot;
+}
+
+// First-fit reuse of a freed region, otherwise grow the spill file
+static void slot_alloc(struct sample_buffer* buf, size_t capacity) {
+    struct spill_slot* prev = NULL;
+    struct spill_slot* slot = pager.free_slots;
+    while (slot && slot->capacity < capacity) {
+        prev = slot;
+        slot = slot->next;
+    }
+
+    if (slot) {
+        if (prev) {
+            prev->next = slot->next;
+        } else {
+            pager.free_slots = slot->next;
+        }
+        buf->spill_offset = slot->offset;
+        buf->spill_capacity = slot->capacity;
+        free(slot);
+    } else {
+        buf->spill_offset = pager.spill_end;
+        buf->spill_capacity = capacity;
+        pager.spill_end += (long long)(capacity * sizeof(int16_t));
+    }
+    buf->spilled = true;
+    pager.spilled += buf->spill_capacity * sizeof(int16_t);
+}
+
+static void slot_drop(struct sample_buffer* buf) {
+    if (!buf->spilled) return;
+    slot_free(buf->spill_offset, buf->spill_capacity);
+    pager.spilled -= buf->spill_capacity * sizeof(int16_t);
+    buf->spilled = false;
+    buf->spill_capacity = 0;
+}
+
+static bool evict(struct sample_buffer* buf) {
+    // Clean buffers already have an up-to-date copy on disk or in a mapping
+    if (buf->dirty || (!buf->spilled && !buf->backing)) {
+        if (pager.fd < 0 && !spill_open(NULL)) return false;
+
+        if (buf->spilled && buf->spill_capacity < buf->length) {
+            slot_drop(buf);
+        }
+        if (!buf->spilled) {
+            slot_alloc(buf, buf->length ? buf->length : 1);
+        }
+        if (!spill_io(true, buf->data, buf->length * sizeof(int16_t),
+                      buf->spill_offset)) {
+            printf("pager: Failed to write spill file\n");
+            return false;
+        }
+    }
+
+    lru_unlink(buf);
+    free(buf->data);
+    buf->data = NULL;
+    buf->dirty = false;
+    pager.resident -= buf->capacity * sizeof(int16_t);
+    pager.evictions++;
+    return true;
+}
+
+// Evict cold buffers until `bytes` more fit in the budget. The budget is a
+// cache target: if every resident buffer is pinned we go over it.
+static void make_room(size_t bytes) {
+    if (pager.budget == 0) return;
+
+    struct sample_buffer* victim = pager.lru_tail;
+    while (victim && pager.resident + bytes > pager.budget) {
+        struct sample_buffer* prev = victim->lru_prev;
+        if (victim->pins == 0 && !evict(victim)) break;
+        victim = prev;
+    }
+}
+
+static bool fault_in(struct sample_buffer* buf) {
+    size_t bytes = buf->capacity * sizeof(int16_t);
+    make_room(bytes);
+
+    int16_t* data = malloc(bytes ? bytes : 1);
+    if (!data) return false;
+
+    if (buf->spilled) {
+        if (!spill_io(false, data, buf->length * sizeof(int16_t), buf->spill_offset)) {
+            printf("pager: Failed to read spill file\n");
+            free(data);
+            return false;
+        }
+    } else if (buf->backing) {
+        memcpy(data, buf->backing, buf->length * sizeof(int16_t));
+    }
+
+    buf->data = data;
+    buf->dirty = false;
+    pager.resident += bytes;
+    lru_push_front(buf);
+    return true;
+}
+
+struct sample_buffer* buffer_create(size_t capacity, struct memory_ledger* ledger) {
+    size_t bytes = capacity * sizeof(int16_t);
+    if (!charge(ledger, bytes)) return NULL;
+    make_room(bytes);
+
+    struct sample_buffer* buf = calloc(1, sizeof(struct sample_buffer));
+    if (buf) {
+        buf->data = malloc(bytes ? bytes : 1);
+    }
+    if (!buf || !buf->data) {
+        free(buf);
+        uncharge(ledger, bytes);
+        return NULL;
+    }
+
+    buf->ledger = ledger;
+    if (ledger) ledger->refs++;
+    buf->capacity = capacity;
+    buf->refcount = 1;
+    buf->dirty = true;
+    pager.resident += capacity * sizeof(int16_t);
+    lru_push_front(buf);
+    return buf;
+}
+
+struct sample_buffer* buffer_create_mapped(struct mapped_file* mapping,
+                                           const int16_t* samples, size_t length) {
+    struct sample_buffer* buf = calloc(1, sizeof(struct sample_buffer));
+    if (!buf) return NULL;
+
+    buf->length = length;
+    buf->capacity = length;
+    buf->refcount = 1;
+    buf->backing = samples;
+    buf->mapping = mapping;
+    mapping->refs++;
+    return buf;
+}
+
+void mapped_file_release(struct mapped_file* mapping) {
+    if (!mapping || --mapping->refs > 0) return;
+
+    munmap(mapping->base, mapping->size);
+    free(mapping);
+}
+
+struct sample_buffer* buffer_retain(struct sample_buffer* buf) {
+    if (buf) buf->refcount++;
+    return buf;
+}
+
+void buffer_release(struct sample_buffer* buf) {
+    if (!buf || --buf->refcount > 0) return;
+
+    dedup_forget(buf);
+    if (buf->data) {
+        lru_unlink(buf);
+        free(buf->data);
+        pager.resident -= buf->capacity * sizeof(int16_t);
+    }
+    slot_drop(buf);
+    mapped_file_release(buf->mapping);
+    if (buf->ledger) {
+        uncharge(buf->ledger, buf->capacity * sizeof(int16_t));
+        ledger_release(buf->ledger);
+    }
+    free(buf);
+}
+
+int16_t* buffer_data(struct sample_buffer* buf) {
+    if (!buf) return NULL;
+
+    if (buf->data) {
+        if (pager.lru_head != buf) {
+            lru_unlink(buf);
+            lru_push_front(buf);
+        }
+        return buf->data;
+    }
+
+    if (!fault_in(buf)) return NULL;
+    pager.faults++;
+    return buf->data;
+}
+
+void buffer_mark_dirty(struct sample_buffer* buf) {
+    if (buf) buf->dirty = true;
+}
+
+bool buffer_resize(struct sample_buffer* buf, size_t capacity) {
+    if (!buf) return false;
+    if (capacity == buf->capacity) return true;
+
+    // Only buffers we allocated are charged; mapped ones have no ledger
+    size_t old_bytes = buf->capacity * sizeof(int16_t);
+    size_t new_bytes = capacity * sizeof(int16_t);
+    bool charged = buf->ledger && new_bytes > old_bytes;
+    if (charged && !charge(buf->ledger, new_bytes - old_bytes)) return false;
+
+    buffer_pin(buf);
+    bool ok = buffer_data(buf) != NULL;
+    if (ok && capacity > buf->capacity) {
+        make_room((capacity - buf->capacity) * sizeof(int16_t));
+    }
+    buffer_unpin(buf);
+
+    int16_t* resized = ok ? realloc(buf->data, new_bytes ? new_bytes : 1) : NULL;
+    if (!resized) {
+        if (charged) uncharge(buf->ledger, new_bytes - old_bytes);
+        return false;
+    }
+    if (buf->ledger && new_bytes < old_bytes) {
+        uncharge(buf->ledger, old_bytes - new_bytes);
+    }
+
+    pager.resident -= buf->capacity * sizeof(int16_t);
+    pager.resident += capacity * sizeof(int16_t);
+    buf->data = resized;
+    buf->capacity = capacity;
+    if (buf->length > capacity) {
+        buf->length = capacity;
+    }
+    buf->dirty = true;
+    return true;
+}
+
+void buffer_pin(struct sample_buffer* buf) {
+    if (buf) buf->pins++;
+}
+
+void buffer_unpin(struct sample_buffer* buf) {
+    if (buf && buf->pins > 0) buf->pins--;
+}
+
+void pager_readahead(const struct audio_node* node) {
+    if (pager.budget == 0 || pager.prefetch == 0) return;
+
+    // Never read ahead more than half the budget, otherwise the prefetched
+    // buffers would push out the ones the caller is working on
+    size_t window = 0;
+    size_t limit = pager.budget / 2;
+    while (node && window < pager.prefetch) {
+        struct sample_buffer* buf = node->buffer;
+        size_t bytes = buf ? buf->capacity * sizeof(int16_t) : 0;
+        if (buf && !buf->data) {
+            if (bytes > limit || !fault_in(buf)) break;
+            limit -= bytes;
+            pager.prefetches++;
+        }
+        window += node->length;
+        node = node->next;
+    }
+}
+
+bool tr_pager_configure(const char* spill_path, size_t budget_bytes,
+                        size_t prefetch_samples) {
+    if (spill_path) {
+        // Moving the spill file would orphan data that is already on disk
+        if (pager.spilled > 0) {
+            printf("pager: Cannot change spill file while buffers are spilled\n");
+            return false;
+        }
+        if (!spill_open(spill_path)) return false;
+
+        while (pager.free_slots) {
+            struct spill_slot* next = pager.free_slots->next;
+            free(pager.free_slots);
+            pager.free_slots = next;
+        }
+    }
+
+    pager.budget = budget_bytes;
+    pager.prefetch = prefetch_samples;
+    make_room(0);
+    return true;
+}
+
+void tr_set_budget(struct sound_seg* track, size_t budget_bytes) {
+    if (track && track->ledger) track->ledger->budget = budget_bytes;
+}
+
+void tr_set_global_budget(size_t budget_bytes) {
+    budget.budget = budget_bytes;
+}
+
+void tr_set_budget_hook(tr_budget_hook hook, void* user_data) {
+    budget.hook = hook;
+    budget.hook_data = user_data;
+}
+
+void tr_pager_stats(struct tr_pager_stats* stats) {
+    if (!stats) return;
+
+    stats->budget_bytes = pager.budget;
+    stats->resident_bytes = pager.resident;
+    stats->spilled_bytes = pager.spilled;
+    stats->faults = pager.faults;
+    stats->prefetches = pager.prefetches;
+    stats->evictions = pager.evictions;
+}
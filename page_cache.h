@@ -0,0 +1,79 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "sound_seg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Internal sample buffer management shared by the library sources.
+// Buffers live in an LRU list while resident; when the configured budget
+// is exceeded the least recently used unpinned buffers are written to the
+// spill file and their memory released until they are touched again.
+
+// Per-track allocation account. Reference counted by the track and by every
+// buffer charged to it, so buffers outliving their track can still uncharge.
+struct memory_ledger {
+    struct sound_seg* track;     // NULL once the track is destroyed
+    size_t allocated;            // Capacity bytes of live buffers charged here
+    size_t budget;               // 0 = unlimited
+    size_t refs;
+};
+
+struct memory_ledger* ledger_create(struct sound_seg* track);
+void ledger_release(struct memory_ledger* ledger);
+
+// Allocate a resident buffer with room for `capacity` samples (refcount 1),
+// charged to `ledger`. Returns NULL if a budget refuses the allocation.
+struct sample_buffer* buffer_create(size_t capacity, struct memory_ledger* ledger);
+
+// Reference counting; the last release frees memory and spill space
+struct sample_buffer* buffer_retain(struct sample_buffer* buf);
+void buffer_release(struct sample_buffer* buf);
+
+// Fault the buffer in if needed and mark it most recently used.
+// The pointer stays valid until the next call that may evict, unless pinned.
+int16_t* buffer_data(struct sample_buffer* buf);
+
+// Record that the resident copy was modified
+void buffer_mark_dirty(struct sample_buffer* buf);
+
+// Change the allocated capacity (faults the buffer in first); growth is
+// charged to the buffer's ledger and may be refused by a budget
+bool buffer_resize(struct sample_buffer* buf, size_t capacity);
+
+// Memory-mapped file that backs read-only buffers; unmapped when the last
+// buffer referencing it is released
+struct mapped_file {
+    void* base;
+    size_t size;
+    size_t refs;
+};
+
+// Create a non-resident buffer that faults in from `samples` inside `mapping`
+struct sample_buffer* buffer_create_mapped(struct mapped_file* mapping,
+                                           const int16_t* samples, size_t length);
+void mapped_file_release(struct mapped_file* mapping);
+
+// Prevent eviction while several buffers are accessed at once
+void buffer_pin(struct sample_buffer* buf);
+void buffer_unpin(struct sample_buffer* buf);
+
+// Deduplication (dedup.c). dedup_block_size() is 0 while disabled.
+// dedup_acquire() returns a referenced buffer holding `data`, shared with an
+// identical registered block when one exists. dedup_forget() unregisters a
+// buffer before its contents change or it is freed.
+size_t dedup_block_size(void);
+struct sample_buffer* dedup_acquire(const int16_t* data, size_t length,
+                                    struct memory_ledger* ledger);
+void dedup_forget(struct sample_buffer* buf);
+
+// Fault in the buffers following `node` up to the readahead window
+void pager_readahead(const struct audio_node* node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAGE_CACHE_H
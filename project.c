@@ -0,0 +1,592 @@
+#include "sound_seg.h"
+#include "page_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Project file layout (native byte order, all offsets from file start):
+//
+//   project_header
+//   sample data of every distinct buffer, 8-byte aligned
+//   per track: node table, relation table
+//   track table   (track_count entries)
+//   buffer table  (buffer_count entries)
+//
+// The header points at the two tables, so opening only touches the header
+// and the tables of tracks that are actually requested. Constant-run nodes
+// have no buffer: their buffer_index is PROJECT_NONE and `fill` holds the
+// value (version 2; version 1 files contain no runs and remain readable).
+
+#define PROJECT_MAGIC "SNDPROJ1"
+#define PROJECT_VERSION 2
+#define PROJECT_NONE UINT64_MAX
+
+struct project_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t track_count;
+    uint64_t buffer_count;
+    uint64_t track_table_offset;
+    uint64_t buffer_table_offset;
+};
+
+struct project_buffer_entry {
+    uint64_t data_offset;
+    uint64_t length;             // In samples
+};
+
+struct project_track_entry {
+    uint64_t total_length;
+    uint64_t node_count;
+    uint64_t nodes_offset;
+    uint64_t relation_count;
+    uint64_t relations_offset;
+};
+
+struct project_node_entry {
+    uint64_t buffer_index;
+    uint64_t start;
+    uint64_t length;
+    uint64_t owner_index;        // Track index or PROJECT_NONE
+    uint32_t is_shared;
+    int32_t fill;                // Run value when buffer_index is PROJECT_NONE
+};
+
+// Relation kinds, matching the two lists kept by struct sound_seg
+enum {
+    PROJECT_REL_PARENT = 0,
+    PROJECT_REL_CHILD = 1
+};
+
+struct project_relation_entry {
+    uint64_t track_index;        // Track stored in parent_child_node.parent
+    uint64_t parent_start;
+    uint64_t child_start;
+    uint64_t length;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+// Opened project: the mapping plus lazily built tracks and buffers. Tracks
+// built only because a requested track refers to them stay owned by the
+// project until proj_track() hands them out.
+struct sound_project {
+    struct mapped_file* mapping;
+    const struct project_header* header;
+    const struct project_track_entry* track_table;
+    const struct project_buffer_entry* buffer_table;
+    struct sound_seg** tracks;
+    bool* handed_out;                // Track now belongs to the caller
+    size_t* pending;                 // Indices built by the current proj_track()
+    size_t num_pending;
+    struct sample_buffer** buffers;
+};
+
+// Pointer -> index table used while saving so shared buffers are written once
+struct buffer_index {
+    struct sample_buffer** keys;
+    uint64_t* values;
+    size_t capacity;
+    size_t count;
+};
+
+static size_t hash_pointer(const void* p, size_t capacity) {
+    uintptr_t x = (uintptr_t)p;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)(x & (capacity - 1));
+}
+
+static bool index_grow(struct buffer_index* index) {
+    size_t capacity = index->capacity ? index->capacity * 2 : 64;
+    struct sample_buffer** keys = calloc(capacity, sizeof(*keys));
+    uint64_t* values = calloc(capacity, sizeof(*values));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return false;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (!index->keys[i]) continue;
+        size_t slot = hash_pointer(index->keys[i], capacity);
+        while (keys[slot]) slot = (slot + 1) & (capacity - 1);
+        keys[slot] = index->keys[i];
+        values[slot] = index->values[i];
+    }
+
+    free(index->keys);
+    free(index->values);
+    index->keys = keys;
+    index->values = values;
+    index->capacity = capacity;
+    return true;
+}
+
+// Look up `buf`, inserting it with the next free index if it is new
+static bool index_lookup(struct buffer_index* index, struct sample_buffer* buf,
+                         uint64_t* value, bool* inserted) {
+    if ((index->count + 1) * 2 > index->capacity && !index_grow(index)) {
+        return false;
+    }
+
+    size_t slot = hash_pointer(buf, index->capacity);
+    while (index->keys[slot] && index->keys[slot] != buf) {
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+
+    *inserted = !index->keys[slot];
+    if (*inserted) {
+        index->keys[slot] = buf;
+        index->values[slot] = index->count++;
+    }
+    *value = index->values[slot];
+    return true;
+}
+
+static uint64_t track_index_of(struct sound_seg** tracks, size_t num_tracks,
+                               const struct sound_seg* track) {
+    for (size_t i = 0; i < num_tracks; i++) {
+        if (tracks[i] == track) return i;
+    }
+    return PROJECT_NONE;
+}
+
+static bool write_padding(FILE* file) {
+    static const char zeros[8] = {0};
+    long long pos = ftello(file);
+    if (pos < 0) return false;
+    size_t pad = (size_t)((8 - pos % 8) % 8);
+    return pad == 0 || fwrite(zeros, 1, pad, file) == pad;
+}
+
+// Write the samples of every distinct buffer and record their locations
+static bool save_buffers(FILE* file, struct sound_seg** tracks, size_t num_tracks,
+                         struct buffer_index* index,
+                         struct project_buffer_entry** entries) {
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < num_tracks; i++) {
+        if (!tracks[i]) continue;
+        for (struct audio_node* node = tracks[i]->head; node; node = node->next) {
+            uint64_t value;
+            bool inserted;
+            if (!node->buffer) continue;
+            if (!index_lookup(index, node->buffer, &value, &inserted)) return false;
+            if (!inserted) continue;
+
+            if (value >= capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                struct project_buffer_entry* grown = realloc(*entries,
+                                                             capacity * sizeof(**entries));
+                if (!grown) return false;
+                *entries = grown;
+            }
+
+            int16_t* samples = buffer_data(node->buffer);
+            if (!samples || !write_padding(file)) return false;
+
+            (*entries)[value].data_offset = (uint64_t)ftello(file);
+            (*entries)[value].length = node->buffer->length;
+            if (fwrite(samples, sizeof(int16_t), node->buffer->length, file) !=
+                node->buffer->length) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool save_relations(FILE* file, struct sound_seg** tracks, size_t num_tracks,
+                           struct parent_child_node* rel, uint32_t kind,
+                           uint64_t* count) {
+    for (; rel; rel = rel->next) {
+        struct project_relation_entry entry = {
+            .track_index = track_index_of(tracks, num_tracks, rel->parent),
+            .parent_start = rel->parent_start,
+            .child_start = rel->child_start,
+            .length = rel->length,
+            .kind = kind
+        };
+        // Relationships with tracks outside the project cannot be restored
+        if (entry.track_index == PROJECT_NONE) continue;
+        if (fwrite(&entry, sizeof(entry), 1, file) != 1) return false;
+        (*count)++;
+    }
+    return true;
+}
+
+// Open a temporary file next to `filename` that can later be renamed over
+// it. Writing in place would truncate a project that is still mapped by
+// proj_open(), and the buffers reading from that mapping would fault.
+static FILE* open_temporary(const char* filename, char* path, size_t size) {
+    if ((size_t)snprintf(path, size, "%s.XXXXXX", filename) >= size) return NULL;
+
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+
+    // mkstemp() creates 0600; keep the mode of the file being replaced
+    struct stat st;
+    fchmod(fd, stat(filename, &st) == 0 ? (st.st_mode & 07777) : 0644);
+
+    FILE* file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(path);
+    }
+    return file;
+}
+
+bool proj_save(const char* filename, struct sound_seg** tracks, size_t num_tracks) {
+    if (!filename || (!tracks && num_tracks > 0)) return false;
+
+    char temp_path[4096];
+    FILE* file = open_temporary(filename, temp_path, sizeof(temp_path));
+    if (!file) {
+        printf("proj_save: Cannot open file: %s\n", strerror(errno));
+        return false;
+    }
+
+    struct project_header header = {
+        .magic = PROJECT_MAGIC,
+        .version = PROJECT_VERSION,
+        .track_count = num_tracks
+    };
+    struct buffer_index index = {0};
+    struct project_buffer_entry* buffer_entries = NULL;
+    struct project_track_entry* track_entries = calloc(num_tracks ? num_tracks : 1,
+                                                       sizeof(*track_entries));
+    bool ok = track_entries != NULL;
+
+    // Header is rewritten once the table offsets are known
+    ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && save_buffers(file, tracks, num_tracks, &index, &buffer_entries);
+
+    for (size_t i = 0; ok && i < num_tracks; i++) {
+        struct sound_seg* track = tracks[i];
+        if (!track) continue;
+
+        ok = write_padding(file);
+        track_entries[i].total_length = track->total_length;
+        track_entries[i].nodes_offset = (uint64_t)ftello(file);
+
+        for (struct audio_node* node = track->head; ok && node; node = node->next) {
+            uint64_t buffer_index = PROJECT_NONE;
+            bool inserted;
+            if (node->buffer) {
+                ok = index_lookup(&index, node->buffer, &buffer_index, &inserted);
+            }
+
+            struct project_node_entry entry = {
+                .buffer_index = buffer_index,
+                .start = node->buffer ? node->start : 0,
+                .length = node->length,
+                .owner_index = track_index_of(tracks, num_tracks, node->owner),
+                .is_shared = node->is_shared,
+                .fill = node->buffer ? 0 : node->fill
+            };
+            ok = ok && fwrite(&entry, sizeof(entry), 1, file) == 1;
+            track_entries[i].node_count++;
+        }
+
+        track_entries[i].relations_offset = (uint64_t)ftello(file);
+        ok = ok && save_relations(file, tracks, num_tracks, track->parents,
+                                  PROJECT_REL_PARENT, &track_entries[i].relation_count);
+        ok = ok && save_relations(file, tracks, num_tracks, track->children,
+                                  PROJECT_REL_CHILD, &track_entries[i].relation_count);
+    }
+
+    if (ok) {
+        header.buffer_count = index.count;
+        ok = write_padding(file);
+        header.track_table_offset = (uint64_t)ftello(file);
+        ok = ok && fwrite(track_entries, sizeof(*track_entries), num_tracks, file) == num_tracks;
+        header.buffer_table_offset = (uint64_t)ftello(file);
+        ok = ok && fwrite(buffer_entries, sizeof(*buffer_entries), index.count, file) == index.count;
+        ok = ok && fseek(file, 0, SEEK_SET) == 0;
+        ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    // Make the new contents durable before they replace the old file
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0) ok = false;
+    ok = ok && rename(temp_path, filename) == 0;
+    if (!ok) {
+        printf("proj_save: Failed to write project\n");
+        unlink(temp_path);
+    }
+
+    free(track_entries);
+    free(buffer_entries);
+    free(index.keys);
+    free(index.values);
+    return ok;
+}
+
+// Check that `count` entries of `size` bytes at `offset` lie inside the file
+static bool range_valid(const struct sound_project* project, uint64_t offset,
+                        uint64_t count, size_t size) {
+    uint64_t file_size = project->mapping->size;
+    if (offset > file_size || offset % 8 != 0) return false;
+    return count <= (file_size - offset) / size;
+}
+
+struct sound_project* proj_open(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("proj_open: Cannot open file\n");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct project_header)) {
+        printf("proj_open: Invalid project file\n");
+        close(fd);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("proj_open: Cannot map file\n");
+        return NULL;
+    }
+
+    struct sound_project* project = calloc(1, sizeof(struct sound_project));
+    struct mapped_file* mapping = calloc(1, sizeof(struct mapped_file));
+    if (!project || !mapping) {
+        free(project);
+        free(mapping);
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+
+    // The project handle holds one reference until proj_close()
+    mapping->base = base;
+    mapping->size = (size_t)st.st_size;
+    mapping->refs = 1;
+    project->mapping = mapping;
+    project->header = base;
+
+    const struct project_header* header = project->header;
+    if (memcmp(header->magic, PROJECT_MAGIC, 8) != 0 ||
+        header->version < 1 || header->version > PROJECT_VERSION ||
+        !range_valid(project, header->track_table_offset, header->track_count,
+                     sizeof(struct project_track_entry)) ||
+        !range_valid(project, header->buffer_table_offset, header->buffer_count,
+                     sizeof(struct project_buffer_entry))) {
+        printf("proj_open: Invalid project header\n");
+        proj_close(project);
+        return NULL;
+    }
+
+    project->track_table = (const void*)((const char*)base + header->track_table_offset);
+    project->buffer_table = (const void*)((const char*)base + header->buffer_table_offset);
+    size_t track_slots = header->track_count ? header->track_count : 1;
+    project->tracks = calloc(track_slots, sizeof(*project->tracks));
+    project->handed_out = calloc(track_slots, sizeof(*project->handed_out));
+    project->pending = calloc(track_slots, sizeof(*project->pending));
+    project->buffers = calloc(header->buffer_count ? header->buffer_count : 1,
+                              sizeof(*project->buffers));
+    if (!project->tracks || !project->handed_out || !project->pending ||
+        !project->buffers) {
+        proj_close(project);
+        return NULL;
+    }
+
+    return project;
+}
+
+size_t proj_track_count(struct sound_project* project) {
+    return project ? (size_t)project->header->track_count : 0;
+}
+
+// Buffers are created on first reference and shared by every node using them
+static struct sample_buffer* project_buffer(struct sound_project* project, uint64_t index) {
+    if (index >= project->header->buffer_count) return NULL;
+    if (project->buffers[index]) return project->buffers[index];
+
+    const struct project_buffer_entry* entry = &project->buffer_table[index];
+    if (!range_valid(project, entry->data_offset, entry->length, sizeof(int16_t))) {
+        return NULL;
+    }
+
+    const int16_t* samples = (const void*)((const char*)project->mapping->base +
+                                           entry->data_offset);
+    project->buffers[index] = buffer_create_mapped(project->mapping, samples,
+                                                   (size_t)entry->length);
+    return project->buffers[index];
+}
+
+static struct sound_seg* build_track(struct sound_project* project, size_t index);
+
+static bool build_nodes(struct sound_project* project, struct sound_seg* track,
+                        const struct project_track_entry* entry) {
+    const struct project_node_entry* nodes = (const void*)(
+        (const char*)project->mapping->base + entry->nodes_offset);
+    struct audio_node* tail = NULL;
+    uint64_t total = 0;
+
+    for (uint64_t i = 0; i < entry->node_count; i++) {
+        bool run = nodes[i].buffer_index == PROJECT_NONE && project->header->version >= 2;
+        struct sample_buffer* buf = NULL;
+        if (run) {
+            if (nodes[i].length == 0 || nodes[i].fill < INT16_MIN ||
+                nodes[i].fill > INT16_MAX) return false;
+        } else {
+            buf = project_buffer(project, nodes[i].buffer_index);
+            if (!buf || nodes[i].length == 0 || nodes[i].start > buf->length ||
+                nodes[i].length > buf->length - nodes[i].start) {
+                return false;
+            }
+        }
+
+        struct audio_node* node = malloc(sizeof(struct audio_node));
+        if (!node) return false;
+
+        node->buffer = buffer_retain(buf);
+        node->fill = (int16_t)nodes[i].fill;
+        node->start = (size_t)nodes[i].start;
+        node->length = (size_t)nodes[i].length;
+        node->is_shared = nodes[i].is_shared != 0;
+        node->owner = NULL;
+        node->next = NULL;
+
+        if (tail) {
+            tail->next = node;
+        } else {
+            track->head = node;
+        }
+        tail = node;
+        total += nodes[i].length;
+
+        // Owners are resolved after the node is linked so that a failure
+        // still leaves the track in a state tr_destroy can clean up
+        if (nodes[i].owner_index != PROJECT_NONE) {
+            node->owner = build_track(project, (size_t)nodes[i].owner_index);
+            if (!node->owner) return false;
+        }
+    }
+
+    return total == entry->total_length;
+}
+
+static bool build_relations(struct sound_project* project, struct sound_seg* track,
+                            const struct project_track_entry* entry) {
+    const struct project_relation_entry* rels = (const void*)(
+        (const char*)project->mapping->base + entry->relations_offset);
+
+    // Entries were written in list order; append to keep it
+    struct parent_child_node** parents_tail = &track->parents;
+    struct parent_child_node** children_tail = &track->children;
+
+    for (uint64_t i = 0; i < entry->relation_count; i++) {
+        struct sound_seg* other = build_track(project, (size_t)rels[i].track_index);
+        if (!other) return false;
+
+        struct parent_child_node* rel = malloc(sizeof(struct parent_child_node));
+        if (!rel) return false;
+
+        rel->parent = other;
+        rel->parent_start = (size_t)rels[i].parent_start;
+        rel->child_start = (size_t)rels[i].child_start;
+        rel->length = (size_t)rels[i].length;
+        rel->next = NULL;
+
+        if (rels[i].kind == PROJECT_REL_PARENT) {
+            *parents_tail = rel;
+            parents_tail = &rel->next;
+        } else {
+            *children_tail = rel;
+            children_tail = &rel->next;
+        }
+    }
+    return true;
+}
+
+// Build track `index` and, recursively, the tracks its nodes and relations
+// refer to. A failed build leaves its partial tracks registered and listed
+// in `pending` so proj_track() can tear the whole attempt down together.
+static struct sound_seg* build_track(struct sound_project* project, size_t index) {
+    if (index >= project->header->track_count) return NULL;
+    if (project->tracks[index]) return project->tracks[index];
+
+    const struct project_track_entry* entry = &project->track_table[index];
+    if (!range_valid(project, entry->nodes_offset, entry->node_count,
+                     sizeof(struct project_node_entry)) ||
+        !range_valid(project, entry->relations_offset, entry->relation_count,
+                     sizeof(struct project_relation_entry))) {
+        printf("proj_track: Invalid track table\n");
+        return NULL;
+    }
+
+    struct sound_seg* track = tr_init();
+    if (!track) return NULL;
+
+    // Register before building so relations back to this track terminate
+    project->tracks[index] = track;
+    project->pending[project->num_pending++] = index;
+    track->total_length = (size_t)entry->total_length;
+
+    if (!build_nodes(project, track, entry) ||
+        !build_relations(project, track, entry)) {
+        printf("proj_track: Invalid track %zu\n", index);
+        return NULL;
+    }
+
+    return track;
+}
+
+struct sound_seg* proj_track(struct sound_project* project, size_t index) {
+    if (!project) return NULL;
+
+    // The caller owns a returned track, so it is handed out only once
+    if (index < project->header->track_count && project->handed_out[index]) {
+        printf("proj_track: Track %zu was already returned\n", index);
+        return NULL;
+    }
+
+    struct sound_seg* track = build_track(project, index);
+    if (!track) {
+        // Tracks built by this call may point at each other, so they are
+        // destroyed as a group; tracks from earlier calls never refer to them
+        for (size_t i = 0; i < project->num_pending; i++) {
+            size_t built = project->pending[i];
+            tr_destroy(project->tracks[built]);
+            project->tracks[built] = NULL;
+        }
+    }
+    project->num_pending = 0;
+
+    if (track) project->handed_out[index] = true;
+    return track;
+}
+
+void proj_close(struct sound_project* project) {
+    if (!project) return;
+
+    // Tracks handed out belong to the caller; the ones built only as owners
+    // or relatives of those are ours. Buffers keep the mapping alive as needed.
+    if (project->tracks && project->handed_out) {
+        for (uint64_t i = 0; i < project->header->track_count; i++) {
+            if (!project->handed_out[i]) tr_destroy(project->tracks[i]);
+        }
+    }
+    if (project->buffers) {
+        for (uint64_t i = 0; i < project->header->buffer_count; i++) {
+            buffer_release(project->buffers[i]);
+        }
+    }
+    free(project->buffers);
+    free(project->pending);
+    free(project->handed_out);
+    free(project->tracks);
+    mapped_file_release(project->mapping);
+    free(project);
+}
@@ -0,0 +1,690 @@
+#include "sound_seg.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Re-executes a trace captured with `make TRACE=1` against the library and
+// reports per-op latency histograms next to the latencies recorded in the
+// trace, so one session can be replayed against several library versions.
+// Saves are redirected to a scratch file so replay never touches the
+// original outputs; loads read the recorded paths, except that a project
+// saved earlier in the trace is reopened from its scratch copy so it has
+// the contents it had when recorded. A recorded spill path is
+// not reused (the pager spills to $TMPDIR), and a recorded budget hook is
+// replayed as none, since declining is all a replay hook could do.
+
+#define NUM_BUCKETS 64               // Bucket b holds latencies in [2^b, 2^(b+1)) ns
+
+struct op_stats {
+    size_t count;
+    size_t diverged;                 // Result differed from the recorded one
+    uint64_t total_ns;
+    uint64_t recorded_ns;
+    uint64_t max_ns;
+    size_t buckets[NUM_BUCKETS];
+};
+
+static const char* op_names[TRACE_OP_COUNT] = {
+    [TRACE_OP_INIT] = "init",
+    [TRACE_OP_DESTROY] = "destroy",
+    [TRACE_OP_LENGTH] = "length",
+    [TRACE_OP_READ] = "read",
+    [TRACE_OP_WRITE] = "write",
+    [TRACE_OP_DELETE] = "delete",
+    [TRACE_OP_IDENTIFY] = "identify",
+    [TRACE_OP_INSERT] = "insert",
+    [TRACE_OP_RESOLVE] = "resolve",
+    [TRACE_OP_WAV_LOAD] = "wav_load",
+    [TRACE_OP_WAV_SAVE] = "wav_save",
+    [TRACE_OP_LOAD_WAV] = "load_wav",
+    [TRACE_OP_SAVE_WAV] = "save_wav",
+    [TRACE_OP_SESSION_BEGIN] = "id_begin",
+    [TRACE_OP_SESSION_REFRESH] = "id_refresh",
+    [TRACE_OP_SESSION_END] = "id_end",
+    [TRACE_OP_IDENTIFY_EACH] = "id_each",
+    [TRACE_OP_FILL] = "fill",
+    [TRACE_OP_SILENCE] = "silence",
+    [TRACE_OP_PAGER_CONFIGURE] = "pager_cfg",
+    [TRACE_OP_PAGER_STATS] = "pager_stat",
+    [TRACE_OP_DEDUP_CONFIGURE] = "dedup_cfg",
+    [TRACE_OP_DEDUP_STATS] = "dedup_stat",
+    [TRACE_OP_SET_BUDGET] = "budget",
+    [TRACE_OP_SET_GLOBAL_BUDGET] = "gbudget",
+    [TRACE_OP_SET_BUDGET_HOOK] = "hook",
+    [TRACE_OP_MEMORY_USAGE] = "mem_usage",
+    [TRACE_OP_PROJ_SAVE] = "proj_save",
+    [TRACE_OP_PROJ_OPEN] = "proj_open",
+    [TRACE_OP_PROJ_TRACK] = "proj_track",
+    [TRACE_OP_PROJ_TRACK_COUNT] = "proj_count",
+    [TRACE_OP_PROJ_CLOSE] = "proj_close",
+    [TRACE_OP_LOAD_BATCH] = "load_batch",
+    [TRACE_OP_SAVE_BATCH] = "save_batch",
+};
+
+static struct {
+    FILE* file;
+    struct sound_seg** tracks;       // Index = trace id
+    struct identify_session** sessions; // Same ids, NULL where a track lives
+    struct sound_project** projects; // Same ids as well
+    size_t num_tracks;
+    int16_t* scratch;                // Read/write sample buffer
+    size_t scratch_len;
+    char path[4096];
+    char save_path[64];
+    char** project_paths;            // Recorded paths of saved projects
+    size_t num_projects;             // Project i is saved to save_path.proj<i>
+    struct op_stats stats[TRACE_OP_COUNT];
+} rp;
+
+static bool get(void* data, size_t size) {
+    return size == 0 || fread(data, size, 1, rp.file) == 1;
+}
+
+static bool get_u32(uint32_t* v) { return get(v, sizeof(*v)); }
+
+static bool get_size(size_t* v) {
+    uint64_t raw;
+    if (!get(&raw, sizeof(raw))) return false;
+    *v = (size_t)raw;
+    return true;
+}
+
+static bool get_path(void) {
+    uint32_t len;
+    if (!get_u32(&len) || len >= sizeof(rp.path)) return false;
+    rp.path[len] = '\0';
+    return get(rp.path, len);
+}
+
+static int16_t* scratch(size_t len) {
+    if (len == 0) len = 1;
+    if (len > rp.scratch_len) {
+        int16_t* grown = realloc(rp.scratch, len * sizeof(int16_t));
+        if (!grown) return NULL;
+        rp.scratch = grown;
+        rp.scratch_len = len;
+    }
+    return rp.scratch;
+}
+
+static bool ensure_slot(uint32_t id) {
+    if (id < rp.num_tracks) return true;
+
+    size_t num_tracks = (size_t)id + 1;
+    struct sound_seg** grown = realloc(rp.tracks, num_tracks * sizeof(*grown));
+    if (!grown) return false;
+    memset(grown + rp.num_tracks, 0, (num_tracks - rp.num_tracks) * sizeof(*grown));
+    rp.tracks = grown;
+
+    struct identify_session** sessions = realloc(rp.sessions, num_tracks * sizeof(*sessions));
+    if (!sessions) return false;
+    memset(sessions + rp.num_tracks, 0, (num_tracks - rp.num_tracks) * sizeof(*sessions));
+    rp.sessions = sessions;
+
+    struct sound_project** projects = realloc(rp.projects, num_tracks * sizeof(*projects));
+    if (!projects) return false;
+    memset(projects + rp.num_tracks, 0, (num_tracks - rp.num_tracks) * sizeof(*projects));
+    rp.projects = projects;
+    rp.num_tracks = num_tracks;
+    return true;
+}
+
+// Tracks first seen mid-trace (e.g. built by proj_track) start out empty
+static bool get_track(struct sound_seg** track) {
+    uint32_t id;
+    if (!get_u32(&id)) return false;
+    if (id == UINT32_MAX) {
+        *track = NULL;
+        return true;
+    }
+
+    if (!ensure_slot(id)) return false;
+    if (!rp.tracks[id]) rp.tracks[id] = tr_init();
+    *track = rp.tracks[id];
+    return *track != NULL;
+}
+
+static bool get_project(struct sound_project** project, uint32_t* id) {
+    if (!get_u32(id)) return false;
+    if (*id != UINT32_MAX && !ensure_slot(*id)) return false;
+    *project = *id == UINT32_MAX ? NULL : rp.projects[*id];
+    return true;
+}
+
+// Track id list as recorded by RESOLVE and PROJ_SAVE
+static bool get_track_list(struct sound_seg*** list, uint32_t* count) {
+    if (!get_u32(count)) return false;
+    *list = malloc((*count ? *count : 1) * sizeof(**list));
+    if (!*list) return false;
+    for (uint32_t i = 0; i < *count; i++) {
+        if (!get_track(&(*list)[i])) return false;
+    }
+    return true;
+}
+
+// Per-file paths of a batch record, each copied out of rp.path
+static char** alloc_names(uint32_t count) {
+    return calloc(count ? count : 1, sizeof(char*));
+}
+
+static void free_names(char** names, uint32_t count) {
+    for (uint32_t i = 0; names && i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+// Scratch file for the project recorded at rp.path. With `add`, a path not
+// saved before gets a new scratch file; otherwise NULL means "not saved".
+static char* project_scratch(bool add, char* out, size_t size) {
+    size_t i = 0;
+    while (i < rp.num_projects && strcmp(rp.project_paths[i], rp.path) != 0) {
+        i++;
+    }
+    if (i == rp.num_projects) {
+        if (!add) return NULL;
+        char** grown = realloc(rp.project_paths, (i + 1) * sizeof(*grown));
+        if (!grown) return NULL;
+        rp.project_paths = grown;
+        if (!(grown[i] = strdup(rp.path))) return NULL;
+        rp.num_projects++;
+    }
+    snprintf(out, size, "%s.proj%zu", rp.save_path, i);
+    return out;
+}
+
+// Bind a track the library created during replay to its trace id
+static void adopt_track(uint32_t id, struct sound_seg* track) {
+    if (id == UINT32_MAX || !ensure_slot(id)) {
+        tr_destroy(track);
+        return;
+    }
+    if (rp.tracks[id] != track) tr_destroy(rp.tracks[id]);
+    rp.tracks[id] = track;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void record(uint8_t op, bool expected, bool result,
+                   uint64_t recorded_ns, uint64_t ns) {
+    struct op_stats* s = &rp.stats[op];
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && (ns >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+
+    s->count++;
+    s->diverged += expected != result;
+    s->total_ns += ns;
+    s->recorded_ns += recorded_ns;
+    if (ns > s->max_ns) s->max_ns = ns;
+    s->buckets[bucket]++;
+}
+
+static void count_match(void* context, size_t start, size_t end) {
+    (void)start;
+    (void)end;
+    (*(uint32_t*)context)++;
+}
+
+// Execute one record; arguments are decoded before the clock starts so
+// only the library call is timed
+static bool replay_op(uint8_t op) {
+    uint8_t expected;
+    uint64_t start_ns, recorded_ns;
+    if (!get(&expected, 1) || !get(&start_ns, 8) || !get(&recorded_ns, 8)) return false;
+
+    struct sound_seg* track = NULL;
+    struct sound_seg* other = NULL;
+    struct sound_seg** list = NULL;
+    struct identify_session* session = NULL;
+    struct sound_project* project = NULL;
+    struct wav_batch_options options = {0};
+    struct wav_batch_result* results = NULL;
+    char** names = NULL;
+    uint32_t* ids = NULL;
+    int16_t* samples = NULL;
+    uint32_t id = 0, count = 0, matches = 0, track_id = UINT32_MAX;
+    size_t pos = 0, len = 0, srcpos = 0;
+    int16_t value = 0;
+    uint8_t flag = 0;
+    bool decoded = true;
+    char project_path[96];
+    const char* open_path = rp.path;
+
+    switch (op) {
+        case TRACE_OP_INIT:
+            // The recorded track gets a fresh replay track below
+            if (!get_u32(&id)) return false;
+            if (id != UINT32_MAX) {
+                if (!ensure_slot(id)) return false;
+                if (rp.tracks[id]) tr_destroy(rp.tracks[id]);
+                rp.tracks[id] = NULL;
+            }
+            break;
+        case TRACE_OP_DESTROY:
+            if (!get_u32(&id)) return false;
+            if (id == UINT32_MAX) break;
+            if (!ensure_slot(id)) return false;
+            track = rp.tracks[id];
+            rp.tracks[id] = NULL;
+            break;
+        case TRACE_OP_LENGTH:
+            if (!get_track(&track)) return false;
+            break;
+        case TRACE_OP_FILL:
+            if (!get_track(&track) || !get_size(&pos) || !get_size(&len) ||
+                !get(&value, sizeof(value))) return false;
+            break;
+        case TRACE_OP_READ:
+        case TRACE_OP_DELETE:
+        case TRACE_OP_SILENCE:
+            if (!get_track(&track) || !get_size(&pos) || !get_size(&len)) return false;
+            if (op == TRACE_OP_READ && !(samples = scratch(len))) return false;
+            break;
+        case TRACE_OP_WRITE:
+            if (!get_track(&track) || !get_size(&pos) || !get_size(&len)) return false;
+            if (!(samples = scratch(len)) || !get(samples, len * sizeof(int16_t))) return false;
+            break;
+        case TRACE_OP_IDENTIFY:
+        case TRACE_OP_IDENTIFY_EACH:
+            if (!get_track(&track) || !get_track(&other)) return false;
+            break;
+        case TRACE_OP_INSERT:
+            if (!get_track(&track) || !get_size(&pos) ||
+                !get_track(&other) || !get_size(&srcpos) || !get_size(&len)) return false;
+            break;
+        case TRACE_OP_RESOLVE:
+            if (!get_track_list(&list, &count)) {
+                free(list);
+                return false;
+            }
+            break;
+        case TRACE_OP_WAV_LOAD:
+            if (!get_path()) return false;
+            break;
+        case TRACE_OP_WAV_SAVE:
+            // Sample data is not traced; save silence of the same length
+            if (!get_path() || !get_size(&len) || !(samples = scratch(len))) return false;
+            memset(samples, 0, len * sizeof(int16_t));
+            break;
+        case TRACE_OP_LOAD_WAV:
+        case TRACE_OP_SAVE_WAV:
+            if (!get_track(&track) || !get_path()) return false;
+            break;
+        case TRACE_OP_SESSION_BEGIN:
+            if (!get_u32(&id) || !get_track(&track)) return false;
+            if (id != UINT32_MAX) {
+                if (!ensure_slot(id)) return false;
+                tr_identify_end(rp.sessions[id]);
+                rp.sessions[id] = NULL;
+            }
+            break;
+        case TRACE_OP_SESSION_REFRESH:
+        case TRACE_OP_SESSION_END:
+            if (!get_u32(&id)) return false;
+            if (op == TRACE_OP_SESSION_REFRESH && !get_track(&other)) return false;
+            if (id == UINT32_MAX) break;
+            if (!ensure_slot(id)) return false;
+            session = rp.sessions[id];
+            if (op == TRACE_OP_SESSION_END) rp.sessions[id] = NULL;
+            break;
+        case TRACE_OP_PAGER_CONFIGURE:
+            if (!get_path() || !get_size(&pos) || !get_size(&len)) return false;
+            break;
+        case TRACE_OP_PAGER_STATS:
+        case TRACE_OP_DEDUP_STATS:
+            break;
+        case TRACE_OP_DEDUP_CONFIGURE:
+            if (!get(&flag, 1) || !get_size(&len)) return false;
+            break;
+        case TRACE_OP_SET_BUDGET:
+            if (!get_track(&track) || !get_size(&len)) return false;
+            break;
+        case TRACE_OP_SET_GLOBAL_BUDGET:
+            if (!get_size(&len)) return false;
+            break;
+        case TRACE_OP_SET_BUDGET_HOOK:
+            if (!get(&flag, 1)) return false;
+            break;
+        case TRACE_OP_MEMORY_USAGE:
+            if (!get_track(&track)) return false;
+            break;
+        case TRACE_OP_PROJ_SAVE:
+            if (!get_path() || !get_track_list(&list, &count) ||
+                !project_scratch(true, project_path, sizeof(project_path))) {
+                free(list);
+                return false;
+            }
+            break;
+        case TRACE_OP_PROJ_OPEN:
+            if (!get_project(&project, &id) || !get_path()) return false;
+            if (project_scratch(false, project_path, sizeof(project_path))) {
+                open_path = project_path;
+            }
+            if (project) {
+                proj_close(project);
+                rp.projects[id] = NULL;
+            }
+            break;
+        case TRACE_OP_PROJ_TRACK:
+            if (!get_project(&project, &id) || !get_size(&pos) || !get_u32(&track_id)) {
+                return false;
+            }
+            break;
+        case TRACE_OP_PROJ_TRACK_COUNT:
+        case TRACE_OP_PROJ_CLOSE:
+            if (!get_project(&project, &id)) return false;
+            if (op == TRACE_OP_PROJ_CLOSE && id != UINT32_MAX) rp.projects[id] = NULL;
+            break;
+        case TRACE_OP_LOAD_BATCH:
+        case TRACE_OP_SAVE_BATCH:
+            if (!get_u32(&count) || !get_size(&options.threads) ||
+                !get_size(&options.max_inflight_bytes)) return false;
+            names = alloc_names(count);
+            ids = calloc(count ? count : 1, sizeof(*ids));
+            list = calloc(count ? count : 1, sizeof(*list));
+            results = calloc(count ? count : 1, sizeof(*results));
+            decoded = names && ids && list && results;
+            for (uint32_t i = 0; decoded && i < count; i++) {
+                decoded = get_path();
+                if (decoded && op == TRACE_OP_LOAD_BATCH) {
+                    decoded = get(&flag, 1) && get_u32(&ids[i]);
+                    names[i] = decoded ? strdup(rp.path) : NULL;
+                } else if (decoded) {
+                    // Every file of an export goes to its own scratch file
+                    decoded = get_track(&list[i]);
+                    names[i] = malloc(sizeof(rp.save_path) + 16);
+                    if (names[i]) {
+                        snprintf(names[i], sizeof(rp.save_path) + 16, "%s.%u",
+                                 rp.save_path, i);
+                    }
+                }
+                decoded = decoded && names[i];
+            }
+            if (!decoded) {
+                free_names(names, count);
+                free(ids);
+                free(list);
+                free(results);
+                return false;
+            }
+            break;
+        default:
+            printf("replay: Unknown op %u\n", op);
+            return false;
+    }
+
+    bool result = true;
+    uint64_t t0 = now_ns();
+    switch (op) {
+        case TRACE_OP_INIT:
+            track = tr_init();
+            result = track != NULL;
+            break;
+        case TRACE_OP_DESTROY:
+            tr_destroy(track);
+            break;
+        case TRACE_OP_LENGTH:
+            tr_length(track);
+            break;
+        case TRACE_OP_READ:
+            result = tr_read(track, pos, len, samples);
+            break;
+        case TRACE_OP_WRITE:
+            result = tr_write(track, pos, len, samples);
+            break;
+        case TRACE_OP_DELETE:
+            result = tr_delete_range(track, pos, len);
+            break;
+        case TRACE_OP_FILL:
+            result = tr_fill(track, pos, len, value);
+            break;
+        case TRACE_OP_SILENCE:
+            result = tr_insert_silence(track, pos, len);
+            break;
+        case TRACE_OP_IDENTIFY: {
+            char* text = tr_identify(track, other);
+            result = text != NULL;
+            free(text);
+            break;
+        }
+        case TRACE_OP_IDENTIFY_EACH:
+            result = tr_identify_each(track, other, count_match, &matches);
+            break;
+        case TRACE_OP_INSERT:
+            result = tr_insert(track, pos, other, srcpos, len);
+            break;
+        case TRACE_OP_RESOLVE:
+            tr_resolve(list, count);
+            break;
+        case TRACE_OP_WAV_LOAD: {
+            int16_t* loaded = wav_load(rp.path, &len);
+            result = loaded != NULL;
+            free(loaded);
+            break;
+        }
+        case TRACE_OP_WAV_SAVE:
+            result = wav_save(rp.save_path, samples, len);
+            break;
+        case TRACE_OP_LOAD_WAV:
+            result = tr_load_wav(track, rp.path);
+            break;
+        case TRACE_OP_SAVE_WAV:
+            result = tr_save_wav(track, rp.save_path);
+            break;
+        case TRACE_OP_SESSION_BEGIN:
+            session = tr_identify_begin(track);
+            result = session != NULL;
+            break;
+        case TRACE_OP_SESSION_REFRESH: {
+            char* text = tr_identify_refresh(session, other);
+            result = text != NULL;
+            free(text);
+            break;
+        }
+        case TRACE_OP_SESSION_END:
+            tr_identify_end(session);
+            break;
+        case TRACE_OP_PAGER_CONFIGURE:
+            result = tr_pager_configure(NULL, pos, len);
+            break;
+        case TRACE_OP_PAGER_STATS: {
+            struct tr_pager_stats stats;
+            tr_pager_stats(&stats);
+            break;
+        }
+        case TRACE_OP_DEDUP_CONFIGURE:
+            tr_dedup_configure(flag != 0, len);
+            break;
+        case TRACE_OP_DEDUP_STATS: {
+            struct tr_dedup_stats stats;
+            tr_dedup_stats(&stats);
+            break;
+        }
+        case TRACE_OP_SET_BUDGET:
+            tr_set_budget(track, len);
+            break;
+        case TRACE_OP_SET_GLOBAL_BUDGET:
+            tr_set_global_budget(len);
+            break;
+        case TRACE_OP_SET_BUDGET_HOOK:
+            tr_set_budget_hook(NULL, NULL);
+            break;
+        case TRACE_OP_MEMORY_USAGE: {
+            struct tr_memory_usage usage;
+            result = tr_memory_usage(track, &usage);
+            break;
+        }
+        case TRACE_OP_PROJ_SAVE:
+            result = proj_save(project_path, list, count);
+            break;
+        case TRACE_OP_PROJ_OPEN:
+            project = proj_open(open_path);
+            result = project != NULL;
+            break;
+        case TRACE_OP_PROJ_TRACK:
+            track = proj_track(project, pos);
+            result = track != NULL;
+            break;
+        case TRACE_OP_PROJ_TRACK_COUNT:
+            proj_track_count(project);
+            break;
+        case TRACE_OP_PROJ_CLOSE:
+            proj_close(project);
+            break;
+        case TRACE_OP_LOAD_BATCH:
+            result = wav_load_batch((const char**)names, count, &options, results);
+            break;
+        case TRACE_OP_SAVE_BATCH:
+            result = wav_save_batch((const char**)names, list, count, &options, results);
+            break;
+    }
+    uint64_t ns = now_ns() - t0;
+
+    if (op == TRACE_OP_INIT && id != UINT32_MAX) {
+        rp.tracks[id] = track;
+    }
+    if (op == TRACE_OP_SESSION_BEGIN && id != UINT32_MAX) {
+        rp.sessions[id] = session;
+    }
+    if (op == TRACE_OP_PROJ_OPEN && id != UINT32_MAX) {
+        rp.projects[id] = project;
+    } else if (op == TRACE_OP_PROJ_OPEN) {
+        proj_close(project);
+    }
+    if (op == TRACE_OP_PROJ_TRACK && track) {
+        // The project hands out one track per index, so repeated calls
+        // rebind the same pointer
+        adopt_track(track_id, track);
+    }
+    if (op == TRACE_OP_LOAD_BATCH) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (results[i].ok) adopt_track(ids[i], results[i].track);
+        }
+    }
+    if (op == TRACE_OP_SAVE_BATCH) {
+        for (uint32_t i = 0; i < count; i++) {
+            unlink(names[i]);
+        }
+    }
+    free_names(names, count);
+    free(ids);
+    free(results);
+    free(list);
+    record(op, expected, result, recorded_ns, ns);
+    return true;
+}
+
+static void print_report(void) {
+    printf("%-10s %10s %9s %12s %12s %12s %12s\n",
+           "op", "count", "diverged", "mean ns", "recorded", "p99 ns", "max ns");
+    for (int op = 1; op < TRACE_OP_COUNT; op++) {
+        struct op_stats* s = &rp.stats[op];
+        if (s->count == 0) continue;
+
+        // Percentiles resolve to the upper bound of their bucket
+        size_t rank = s->count - s->count / 100, seen = 0;
+        int p99 = 0;
+        while (p99 < NUM_BUCKETS - 1 && (seen += s->buckets[p99]) < rank) {
+            p99++;
+        }
+        printf("%-10s %10zu %9zu %12llu %12llu %12llu %12llu\n",
+               op_names[op], s->count, s->diverged,
+               (unsigned long long)(s->total_ns / s->count),
+               (unsigned long long)(s->recorded_ns / s->count),
+               (unsigned long long)((2ull << p99) - 1),
+               (unsigned long long)s->max_ns);
+    }
+
+    for (int op = 1; op < TRACE_OP_COUNT; op++) {
+        struct op_stats* s = &rp.stats[op];
+        if (s->count == 0) continue;
+
+        printf("\n%s latency histogram:\n", op_names[op]);
+        size_t peak = 0;
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            if (s->buckets[b] > peak) peak = s->buckets[b];
+        }
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            if (s->buckets[b] == 0) continue;
+            int width = (int)(s->buckets[b] * 40 / peak);
+            printf("  < %12llu ns %10zu %.*s\n", (unsigned long long)(2ull << b) - 1,
+                   s->buckets[b], width > 0 ? width : 1,
+                   "########################################");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: %s TRACE_FILE\n", argv[0]);
+        return 1;
+    }
+
+    rp.file = fopen(argv[1], "rb");
+    if (!rp.file) {
+        printf("replay: Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    // Version 1 traces use a subset of the same records
+    char magic[8];
+    if (!get(magic, sizeof(magic)) || (memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 &&
+                                       memcmp(magic, TRACE_MAGIC_V1, sizeof(magic)) != 0)) {
+        printf("replay: %s is not a trace file\n", argv[1]);
+        fclose(rp.file);
+        return 1;
+    }
+
+    strcpy(rp.save_path, "/tmp/replay-XXXXXX");
+    int fd = mkstemp(rp.save_path);
+    if (fd < 0) {
+        printf("replay: Cannot create scratch file\n");
+        fclose(rp.file);
+        return 1;
+    }
+    close(fd);
+
+    size_t ops = 0;
+    bool ok = true;
+    int op;
+    while ((op = fgetc(rp.file)) != EOF) {
+        if (!replay_op((uint8_t)op)) {
+            printf("replay: Truncated or corrupt record %zu\n", ops);
+            ok = false;
+            break;
+        }
+        ops++;
+    }
+    fclose(rp.file);
+    unlink(rp.save_path);
+    for (size_t i = 0; i < rp.num_projects; i++) {
+        char project_path[96];
+        snprintf(project_path, sizeof(project_path), "%s.proj%zu", rp.save_path, i);
+        unlink(project_path);
+        free(rp.project_paths[i]);
+    }
+    free(rp.project_paths);
+
+    printf("Replayed %zu operations\n\n", ops);
+    print_report();
+
+    for (size_t i = 0; i < rp.num_tracks; i++) {
+        tr_identify_end(rp.sessions[i]);
+        proj_close(rp.projects[i]);
+    }
+    for (size_t i = 0; i < rp.num_tracks; i++) {
+        if (rp.tracks[i]) tr_destroy(rp.tracks[i]);
+    }
+    free(rp.tracks);
+    free(rp.sessions);
+    free(rp.projects);
+    free(rp.scratch);
+    return ok ? 0 : 1;
+}
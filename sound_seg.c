@@ -1,4 +1,5 @@
 #include "sound_seg.h"
+#include "page_cache.h"
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -9,10 +10,51 @@ struct chunk_header {
     uint32_t size;
 };
 
+// RIFF sizes at or above this value mean "see the ds64 chunk" (RF64/BW64)
+#define RF64_SIZE_MARKER 0xFFFFFFFFu
+
+// Samples moved per read/write when streaming a WAV file to or from a track
+#define WAV_STREAM_SAMPLES ((size_t)1 << 16)
+
+// Upper bound for the geometric growth of a track's tail buffer, so long
+// recordings are split into buffers the page cache can evict individually
+#define TAIL_MAX_SAMPLES ((size_t)1 << 20)
+
+// Constant stretches at least this long are stored as runs without a buffer
+// when written or appended; shorter ones do not pay for a node of their own
+#define RUN_MIN_SAMPLES ((size_t)1024)
+
 // Forward declarations of static functions
 static struct audio_node* create_shared_node(struct sound_seg* owner,
                                            size_t start, size_t length);
 static bool split_node(struct audio_node* node, size_t pos);
+static struct audio_node* create_data_node(struct sound_seg* track,
+                                           const int16_t* data, size_t length);
+static void free_node_chain(struct audio_node* node);
+static bool append_samples(struct sound_seg* track, struct audio_node* last,
+                           const int16_t* data, size_t length);
+static bool append_data(struct sound_seg* track, struct audio_node* last,
+                        const int16_t* data, size_t length);
+static void note_edit(struct sound_seg* track, size_t pos,
+                      size_t old_length, size_t new_length);
+static void note_change(struct sound_seg* track, size_t pos,
+                        size_t old_length, size_t old_total);
+static bool write_range(struct sound_seg* track, size_t pos, size_t len,
+                        const int16_t* buffer);
+static void note_buffer_write(struct sample_buffer* buf, size_t start, size_t len);
+static struct audio_node* create_run_node(int16_t value, size_t length);
+static bool store_in_run(struct sound_seg* track, struct audio_node* node,
+                         const int16_t* data);
+static bool materialize_range(struct sound_seg* track, size_t pos, size_t len);
+static bool detach_dedup_range(struct sound_seg* track, size_t pos, size_t len);
+static bool remove_range(struct sound_seg* track, size_t pos, size_t len);
+static size_t constant_prefix(const int16_t* data, size_t length, int16_t value);
+static void fill_samples(int16_t* out, int16_t value, size_t length);
+
+// Bumped whenever samples are overwritten in a buffer other nodes reference,
+// which may change tracks that share it without touching their edit logs.
+// The buffer logs the written range with the new value (see shared_spans).
+static uint64_t shared_write_epoch;
 
 // WAV format chunk
 struct fmt_chunk {
@@ -24,164 +66,221 @@ struct fmt_chunk {
     uint16_t bits_per_sample;
 };
 
-// WAV file header structure
-struct wav_header {
-    char riff_id[4];
-    uint32_t size;
-    char wave_id[4];
-    char fmt_id[4];
-    uint32_t fmt_size;
-    uint16_t format;
-    uint16_t channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    char data_id[4];
-    uint32_t data_size;
+// Leading fields of the RF64 ds64 chunk (read and written field by field,
+// the struct itself is padded)
+struct ds64_chunk {
+    uint64_t riff_size;
+    uint64_t data_size;
+    uint64_t sample_count;
+    uint32_t table_length;
 };
 
-// Part 1: WAV file interaction and basic sound operations
-int16_t* wav_load(const char* filename, size_t* length) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("wav_load: Cannot open file\n");
-        return NULL;
-    }
-
+// Read the WAV headers and leave `file` positioned at the first sample.
+// Handles classic RIFF as well as RF64/BW64, whose 64-bit sizes live in the
+// ds64 chunk that must directly follow the WAVE id.
+static bool wav_open_data(FILE* file, struct fmt_chunk* fmt, uint64_t* data_size) {
     // Read RIFF header
     struct chunk_header riff_header;
     if (fread(&riff_header, sizeof(riff_header), 1, file) != 1) {
         printf("wav_load: Failed to read RIFF header\n");
-        fclose(file);
-        return NULL;
+        return false;
     }
 
     // Verify RIFF header
-    if (memcmp(riff_header.id, "RIFF", 4) != 0) {
+    bool rf64 = memcmp(riff_header.id, "RF64", 4) == 0 ||
+                memcmp(riff_header.id, "BW64", 4) == 0;
+    if (memcmp(riff_header.id, "RIFF", 4) != 0 && !rf64) {
         printf("wav_load: Invalid RIFF header\n");
-        fclose(file);
-        return NULL;
+        return false;
     }
 
     // Read WAVE ID
     char wave_id[4];
     if (fread(wave_id, sizeof(wave_id), 1, file) != 1) {
         printf("wav_load: Failed to read WAVE ID\n");
-        fclose(file);
-        return NULL;
+        return false;
     }
 
     // Verify WAVE format
     if (memcmp(wave_id, "WAVE", 4) != 0) {
         printf("wav_load: Invalid WAVE format\n");
-        fclose(file);
-        return NULL;
+        return false;
     }
 
-    struct fmt_chunk fmt;
+    struct ds64_chunk ds64 = {0};
+    bool found_ds64 = false;
     bool found_fmt = false;
-    bool found_data = false;
-    int16_t* samples = NULL;
-    uint32_t data_size = 0;
 
     // Read chunks until we find both fmt and data
-    while (!found_data) {
+    while (true) {
         struct chunk_header chunk;
         if (fread(&chunk, sizeof(chunk), 1, file) != 1) {
             printf("wav_load: Failed to read chunk header\n");
-            break;
+            return false;
         }
 
         printf("Found chunk: %.4s, size: %u\n", chunk.id, chunk.size);
-
-        if (memcmp(chunk.id, "fmt ", 4) == 0) {
+        uint64_t chunk_size = chunk.size;
+
+        if (rf64 && memcmp(chunk.id, "ds64", 4) == 0) {
+            if (chunk.size < 28 ||
+                fread(&ds64.riff_size, sizeof(uint64_t), 1, file) != 1 ||
+                fread(&ds64.data_size, sizeof(uint64_t), 1, file) != 1 ||
+                fread(&ds64.sample_count, sizeof(uint64_t), 1, file) != 1 ||
+                fread(&ds64.table_length, sizeof(uint32_t), 1, file) != 1) {
+                printf("wav_load: Failed to read ds64 chunk\n");
+                return false;
+            }
+            found_ds64 = true;
+            chunk_size -= 28;
+        }
+        else if (memcmp(chunk.id, "fmt ", 4) == 0) {
             // Read format chunk
-            if (fread(&fmt, sizeof(fmt), 1, file) != 1) {
+            if (fread(fmt, sizeof(*fmt), 1, file) != 1) {
                 printf("wav_load: Failed to read fmt chunk\n");
-                break;
+                return false;
             }
             found_fmt = true;
-            
-            // Skip any extra format bytes
-            if (chunk.size > sizeof(fmt)) {
-                fseek(file, chunk.size - sizeof(fmt), SEEK_CUR);
-            }
+            chunk_size = chunk_size > sizeof(*fmt) ? chunk_size - sizeof(*fmt) : 0;
         }
         else if (memcmp(chunk.id, "data", 4) == 0) {
             if (!found_fmt) {
                 printf("wav_load: Found data before fmt chunk\n");
-                break;
+                return false;
             }
 
-            data_size = chunk.size;
-            samples = malloc(data_size);
-            if (!samples) {
-                printf("wav_load: Failed to allocate memory\n");
-                break;
-            }
-
-            size_t read_size = fread(samples, 1, data_size, file);
-            if (read_size != data_size) {
-                printf("wav_load: Failed to read data. Expected %u bytes, got %zu bytes\n",
-                       data_size, read_size);
-                free(samples);
-                samples = NULL;
-                break;
+            *data_size = chunk.size;
+            if (rf64 && chunk.size == RF64_SIZE_MARKER) {
+                if (!found_ds64) {
+                    printf("wav_load: RF64 data chunk without ds64 chunk\n");
+                    return false;
+                }
+                *data_size = ds64.data_size;
             }
-            found_data = true;
+            return true;
         }
         else {
             // Skip unknown chunk
             printf("Skipping chunk: %.4s\n", chunk.id);
-            if (fseek(file, chunk.size, SEEK_CUR) != 0) {
-                printf("wav_load: Failed to skip chunk\n");
-                break;
-            }
+        }
+
+        // Skip the rest of the chunk, including the RIFF pad byte
+        chunk_size += chunk.size & 1;
+        if (chunk_size > 0 && fseeko(file, (off_t)chunk_size, SEEK_CUR) != 0) {
+            printf("wav_load: Failed to skip chunk\n");
+            return false;
         }
     }
+}
 
-    fclose(file);
+static void wav_print_info(const struct fmt_chunk* fmt, uint64_t data_size) {
+    printf("WAV File Info:\n");
+    printf("Format: %u\n", fmt->format);
+    printf("Channels: %u\n", fmt->channels);
+    printf("Sample Rate: %u\n", fmt->sample_rate);
+    printf("Bits per Sample: %u\n", fmt->bits_per_sample);
+    printf("Data Size: %llu\n", (unsigned long long)data_size);
+}
 
-    if (samples && found_fmt && found_data) {
-        printf("WAV File Info:\n");
-        printf("Format: %u\n", fmt.format);
-        printf("Channels: %u\n", fmt.channels);
-        printf("Sample Rate: %u\n", fmt.sample_rate);
-        printf("Bits per Sample: %u\n", fmt.bits_per_sample);
-        printf("Data Size: %u\n", data_size);
-        
-        *length = data_size / sizeof(int16_t);
-        return samples;
+// Part 1: WAV file interaction and basic sound operations
+int16_t* wav_load(const char* filename, size_t* length) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("wav_load: Cannot open file\n");
+        return NULL;
+    }
+
+    struct fmt_chunk fmt;
+    uint64_t data_size = 0;
+    if (!wav_open_data(file, &fmt, &data_size)) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (data_size > SIZE_MAX) {
+        printf("wav_load: Data too large for this platform\n");
+        fclose(file);
+        return NULL;
+    }
+
+    int16_t* samples = malloc(data_size ? (size_t)data_size : 1);
+    if (!samples) {
+        printf("wav_load: Failed to allocate memory\n");
+        fclose(file);
+        return NULL;
     }
 
-    if (samples) {
+    size_t read_size = fread(samples, 1, (size_t)data_size, file);
+    fclose(file);
+    if (read_size != data_size) {
+        printf("wav_load: Failed to read data. Expected %llu bytes, got %zu bytes\n",
+               (unsigned long long)data_size, read_size);
         free(samples);
+        return NULL;
     }
-    return NULL;
-}
 
-bool wav_save(const char* filename, int16_t* samples, size_t length) {
-    FILE* file = fopen(filename, "wb");
-    if (!file) return false;
+    wav_print_info(&fmt, data_size);
+    *length = (size_t)(data_size / sizeof(int16_t));
+    return samples;
+}
 
-    struct wav_header header = {
-        .riff_id = "RIFF",
-        .wave_id = "WAVE",
-        .fmt_id = "fmt ",
-        .data_id = "data",
-        .fmt_size = 16,
+// Write a 16-bit mono PCM header for `data_bytes` of samples. Data that does
+// not fit the 32-bit RIFF sizes gets an RF64 header with a ds64 chunk.
+static bool wav_write_header(FILE* file, uint64_t data_bytes) {
+    const uint32_t fmt_size = 16;
+    const struct fmt_chunk fmt = {
         .format = 1, // PCM
         .channels = 1,
         .sample_rate = 44100,
-        .bits_per_sample = 16,
-        .block_align = 2,
         .byte_rate = 88200,
-        .data_size = length * sizeof(int16_t),
-        .size = 36 + length * sizeof(int16_t)
+        .block_align = 2,
+        .bits_per_sample = 16
     };
+    bool ok = true;
+
+    if (data_bytes + 36 < RF64_SIZE_MARKER) {
+        uint32_t riff_size = (uint32_t)(36 + data_bytes);
+        uint32_t data_size = (uint32_t)data_bytes;
+        ok = ok && fwrite("RIFF", 4, 1, file) == 1;
+        ok = ok && fwrite(&riff_size, sizeof(riff_size), 1, file) == 1;
+        ok = ok && fwrite("WAVEfmt ", 8, 1, file) == 1;
+        ok = ok && fwrite(&fmt_size, sizeof(fmt_size), 1, file) == 1;
+        ok = ok && fwrite(&fmt, sizeof(fmt), 1, file) == 1;
+        ok = ok && fwrite("data", 4, 1, file) == 1;
+        ok = ok && fwrite(&data_size, sizeof(data_size), 1, file) == 1;
+        return ok;
+    }
+
+    const uint32_t marker = RF64_SIZE_MARKER;
+    const uint32_t ds64_size = 28;
+    struct ds64_chunk ds64 = {
+        // RF64 + ds64 + fmt + data headers, minus the first 8 bytes
+        .riff_size = 4 + (8 + 28) + (8 + 16) + 8 + data_bytes,
+        .data_size = data_bytes,
+        .sample_count = data_bytes / sizeof(int16_t),
+        .table_length = 0
+    };
+    ok = ok && fwrite("RF64", 4, 1, file) == 1;
+    ok = ok && fwrite(&marker, sizeof(marker), 1, file) == 1;
+    ok = ok && fwrite("WAVEds64", 8, 1, file) == 1;
+    ok = ok && fwrite(&ds64_size, sizeof(ds64_size), 1, file) == 1;
+    ok = ok && fwrite(&ds64.riff_size, sizeof(uint64_t), 1, file) == 1;
+    ok = ok && fwrite(&ds64.data_size, sizeof(uint64_t), 1, file) == 1;
+    ok = ok && fwrite(&ds64.sample_count, sizeof(uint64_t), 1, file) == 1;
+    ok = ok && fwrite(&ds64.table_length, sizeof(uint32_t), 1, file) == 1;
+    ok = ok && fwrite("fmt ", 4, 1, file) == 1;
+    ok = ok && fwrite(&fmt_size, sizeof(fmt_size), 1, file) == 1;
+    ok = ok && fwrite(&fmt, sizeof(fmt), 1, file) == 1;
+    ok = ok && fwrite("data", 4, 1, file) == 1;
+    ok = ok && fwrite(&marker, sizeof(marker), 1, file) == 1;
+    return ok;
+}
+
+bool wav_save(const char* filename, int16_t* samples, size_t length) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) return false;
 
-    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    if (!wav_write_header(file, (uint64_t)length * sizeof(int16_t))) {
         fclose(file);
         return false;
     }
@@ -191,8 +290,66 @@ bool wav_save(const char* filename, int16_t* samples, size_t length) {
         return false;
     }
 
+    return fclose(file) == 0;
+}
+
+bool tr_load_wav(struct sound_seg* track, const char* filename) {
+    if (!track || !filename) return false;
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("wav_load: Cannot open file\n");
+        return false;
+    }
+
+    struct fmt_chunk fmt;
+    uint64_t data_size = 0;
+    int16_t* chunk = malloc(WAV_STREAM_SAMPLES * sizeof(int16_t));
+    if (!chunk || !wav_open_data(file, &fmt, &data_size)) {
+        free(chunk);
+        fclose(file);
+        return false;
+    }
+
+    // 分块追加到轨道末尾，内存占用与文件大小无关
+    uint64_t remaining = data_size / sizeof(int16_t);
+    bool ok = true;
+    while (ok && remaining > 0) {
+        size_t n = remaining < WAV_STREAM_SAMPLES ? (size_t)remaining : WAV_STREAM_SAMPLES;
+        if (fread(chunk, sizeof(int16_t), n, file) != n) {
+            printf("wav_load: Failed to read data\n");
+            ok = false;
+            break;
+        }
+        ok = tr_write(track, track->total_length, n, chunk);
+        remaining -= n;
+    }
+
+    if (ok) wav_print_info(&fmt, data_size);
+    free(chunk);
     fclose(file);
-    return true;
+    return ok;
+}
+
+bool tr_save_wav(struct sound_seg* track, const char* filename) {
+    if (!track || !filename) return false;
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) return false;
+
+    int16_t* chunk = malloc(WAV_STREAM_SAMPLES * sizeof(int16_t));
+    bool ok = chunk && wav_write_header(file, (uint64_t)track->total_length * sizeof(int16_t));
+
+    for (size_t pos = 0; ok && pos < track->total_length; pos += WAV_STREAM_SAMPLES) {
+        size_t n = track->total_length - pos;
+        if (n > WAV_STREAM_SAMPLES) n = WAV_STREAM_SAMPLES;
+        ok = tr_read(track, pos, n, chunk) &&
+             fwrite(chunk, sizeof(int16_t), n, file) == n;
+    }
+
+    free(chunk);
+    if (fclose(file) != 0) ok = false;
+    return ok;
 }
 
 struct sound_seg* tr_init(void) {
@@ -203,21 +360,22 @@ struct sound_seg* tr_init(void) {
     track->children = NULL;
     track->parents = NULL;
     track->total_length = 0;
+    track->ledger = ledger_create(track);
+    if (!track->ledger) {
+        free(track);
+        return NULL;
+    }
     return track;
 }
 
 void tr_destroy(struct sound_seg* track) {
     if (!track) return;
 
-    struct audio_node* curr = track->head;
-    while (curr) {
-        struct audio_node* next = curr->next;
-        if (curr->samples && !curr->is_shared) {
-            free(curr->samples);
-        }
-        free(curr);
-        curr = next;
-    }
+    free_node_chain(track->head);
+
+    // Buffers still shared with other tracks keep the ledger alive
+    track->ledger->track = NULL;
+    ledger_release(track->ledger);
 
     // Free parent-child relationship nodes
     struct parent_child_node* child = track->children;
@@ -237,6 +395,12 @@ void tr_destroy(struct sound_seg* track) {
     free(track);
 }
 
+const int16_t* tr_node_samples(const struct audio_node* node) {
+    if (!node || !node->buffer) return NULL;
+    int16_t* samples = buffer_data(node->buffer);
+    return samples ? samples + node->start : NULL;
+}
+
 size_t tr_length(struct sound_seg* track) {
     return track ? track->total_length : 0;
 }
@@ -260,15 +424,24 @@ bool tr_read(struct sound_seg* track, size_t pos, size_t len, int16_t* buffer) {
             copy_len = node->length - pos;
         }
 
-        memcpy(buffer + buffer_pos, 
-               node->samples + node->start + pos,
-               copy_len * sizeof(int16_t));
+        if (!node->buffer) {
+            fill_samples(buffer + buffer_pos, node->fill, copy_len);
+        } else {
+            int16_t* samples = buffer_data(node->buffer);
+            if (!samples) return false;
+            memcpy(buffer + buffer_pos, 
+                   samples + node->start + pos,
+                   copy_len * sizeof(int16_t));
+        }
 
         buffer_pos += copy_len;
         pos = 0;
         node = node->next;
     }
 
+    // 预读后续节点，顺序访问时避免缺页
+    pager_readahead(node);
+
     return true;
 }
 
@@ -276,6 +449,18 @@ bool tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* bu
     if (!track || !buffer) return false;
     if (len == 0) return true;
 
+    // Samples past the end are appended, so the edit starts at most there.
+    // A write can fail part way, so it is logged with the change it made.
+    size_t old_total = track->total_length;
+    size_t edit_pos = pos < old_total ? pos : old_total;
+    size_t overwritten = old_total - edit_pos;
+    bool ok = write_range(track, pos, len, buffer);
+    note_change(track, edit_pos, overwritten < len ? overwritten : len, old_total);
+    return ok;
+}
+
+static bool write_range(struct sound_seg* track, size_t pos, size_t len,
+                        const int16_t* buffer) {
     // 找到写入位置
     struct audio_node* curr = track->head;
     struct audio_node* prev = NULL;
@@ -289,30 +474,7 @@ bool tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* bu
 
     // 如果写入位置超出当前长度，需要创建新节点
     if (!curr && pos >= track->total_length) {
-        struct audio_node* new_node = malloc(sizeof(struct audio_node));
-        if (!new_node) return false;
-
-        new_node->samples = malloc(len * sizeof(int16_t));
-        if (!new_node->samples) {
-            free(new_node);
-            return false;
-        }
-
-        memcpy(new_node->samples, buffer, len * sizeof(int16_t));
-        new_node->start = 0;
-        new_node->length = len;
-        new_node->is_shared = false;
-        new_node->owner = NULL;
-        new_node->next = NULL;
-
-        if (prev) {
-            prev->next = new_node;
-        } else {
-            track->head = new_node;
-        }
-
-        track->total_length = pos + len;
-        return true;
+        return append_samples(track, prev, buffer, len);
     }
 
     // 处理写入位置在现有节点内的情况
@@ -324,26 +486,66 @@ bool tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* bu
             write_len = curr->length - write_offset;
         }
 
-        // 如果是共享节点，需要创建新的非共享副本
-        if (curr->is_shared) {
-            int16_t* new_samples = malloc(curr->length * sizeof(int16_t));
-            if (!new_samples) return false;
-
-            // 复制原有数据
-            memcpy(new_samples, curr->samples + curr->start, curr->length * sizeof(int16_t));
+        if (!curr->buffer) {
+            // 常量段：内容不变则跳过，否则只把被写入的部分拆出来
+            if (constant_prefix(buffer, write_len, curr->fill) < write_len) {
+                if (write_offset > 0) {
+                    if (!split_node(curr, write_offset)) return false;
+                    curr_pos += curr->length;
+                    prev = curr;
+                    curr = curr->next;
+                }
+                if (write_len < curr->length && !split_node(curr, write_len)) return false;
+                if (!store_in_run(track, curr, buffer)) return false;
+            }
+        } else if (write_offset == 0 && write_len == curr->length &&
+                   write_len >= RUN_MIN_SAMPLES &&
+                   (curr->is_shared || curr->buffer->dedup || curr->buffer->refcount == 1) &&
+                   constant_prefix(buffer, write_len, buffer[0]) == write_len) {
+            // 整个节点被常量覆盖且写入对其他节点不可见：改为常量段，释放缓冲区
+            buffer_release(curr->buffer);
+            curr->buffer = NULL;
+            curr->fill = buffer[0];
+            curr->start = 0;
+            curr->is_shared = false;
+            curr->owner = NULL;
+        } else if (curr->is_shared ||
+                   (curr->buffer->dedup && curr->buffer->refcount > 1)) {
+            // 如果是共享节点，或去重块仍有其他使用者，需要创建新的非共享副本
+            // （与子轨道共享的块已由 detach_dedup_range 移出去重表，不会走到这里）
+            struct sample_buffer* copy = buffer_create(curr->length, track->ledger);
+            if (!copy) return false;
+
+            // 复制原有数据（固定新缓冲区，防止读取旧数据时被换出）
+            buffer_pin(copy);
+            int16_t* old_samples = buffer_data(curr->buffer);
+            if (!old_samples) {
+                buffer_unpin(copy);
+                buffer_release(copy);
+                return false;
+            }
+            memcpy(copy->data, old_samples + curr->start, curr->length * sizeof(int16_t));
             
             // 写入新数据
-            memcpy(new_samples + write_offset, buffer, write_len * sizeof(int16_t));
+            memcpy(copy->data + write_offset, buffer, write_len * sizeof(int16_t));
+            copy->length = curr->length;
+            buffer_unpin(copy);
 
             // 更新节点
-            curr->samples = new_samples;
+            buffer_release(curr->buffer);
+            curr->buffer = copy;
             curr->start = 0;
             curr->is_shared = false;
             curr->owner = NULL;
         } else {
-            // 直接写入非共享节点
-            memcpy(curr->samples + curr->start + write_offset, 
+            // 直接写入非共享节点（内容改变后不再参与去重）
+            int16_t* samples = buffer_data(curr->buffer);
+            if (!samples) return false;
+            note_buffer_write(curr->buffer, curr->start + write_offset, write_len);
+            dedup_forget(curr->buffer);
+            memcpy(samples + curr->start + write_offset, 
                    buffer, write_len * sizeof(int16_t));
+            buffer_mark_dirty(curr->buffer);
         }
 
         // 更新位置和长度
@@ -351,34 +553,13 @@ bool tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* bu
         len -= write_len;
         pos += write_len;
         curr_pos += curr->length;
+        prev = curr;
         curr = curr->next;
     }
 
-    // 如果还有数据需要写入，创建新节点
+    // 如果还有数据需要写入，追加到末尾（此时 prev 为最后一个节点）
     if (len > 0) {
-        struct audio_node* new_node = malloc(sizeof(struct audio_node));
-        if (!new_node) return false;
-
-        new_node->samples = malloc(len * sizeof(int16_t));
-        if (!new_node->samples) {
-            free(new_node);
-            return false;
-        }
-
-        memcpy(new_node->samples, buffer, len * sizeof(int16_t));
-        new_node->start = 0;
-        new_node->length = len;
-        new_node->is_shared = false;
-        new_node->owner = NULL;
-        new_node->next = curr;
-
-        if (prev) {
-            prev->next = new_node;
-        } else {
-            track->head = new_node;
-        }
-
-        track->total_length = pos + len;
+        return append_samples(track, prev, buffer, len);
     }
 
     // 更新总长度（如果需要）
@@ -397,7 +578,8 @@ static bool split_node(struct audio_node* node, size_t pos) {
     if (!new_node) return false;
 
     // 设置新节点
-    new_node->samples = node->samples;
+    new_node->buffer = buffer_retain(node->buffer);
+    new_node->fill = node->fill;
     new_node->start = node->start + pos;
     new_node->length = node->length - pos;
     new_node->is_shared = node->is_shared;
@@ -425,7 +607,15 @@ bool tr_delete_range(struct sound_seg* track, size_t pos, size_t len) {
         }
         child = child->next;
     }
+    size_t old_total = track->total_length;
+    bool ok = remove_range(track, pos, len);
+    note_change(track, pos, len, old_total);
+    return ok;
+}
 
+// Unlink and release the samples in [pos, pos + len), which must lie
+// within the track
+static bool remove_range(struct sound_seg* track, size_t pos, size_t len) {
     // 找到起始节点
     struct audio_node* curr = track->head;
     struct audio_node* prev = NULL;
@@ -464,9 +654,7 @@ bool tr_delete_range(struct sound_seg* track, size_t pos, size_t len) {
         }
 
         // 释放节点
-        if (!to_delete->is_shared) {
-            free(to_delete->samples);
-        }
+        buffer_release(to_delete->buffer);
         free(to_delete);
     }
 
@@ -495,37 +683,22 @@ bool tr_delete_range(struct sound_seg* track, size_t pos, size_t len) {
                 curr = node_to_delete->next;
                 
                 // 释放代表被删除部分的节点结构体
+                buffer_release(node_to_delete->buffer);
                 free(node_to_delete);
             } else {
-                // 对于非共享节点，使用 memmove + realloc
-                size_t keep_len = curr->length - remaining;
-                if (keep_len > 0) {
-                    memmove(curr->samples, curr->samples + remaining,
-                           keep_len * sizeof(int16_t));
-                    
-                    int16_t* resized = realloc(curr->samples, keep_len * sizeof(int16_t));
-                    if (!resized && keep_len > 0) {
-                        return false;
-                    }
-                    curr->samples = resized;
-                } else {
-                    free(curr->samples);
-                    curr->samples = NULL;
-                }
-                curr->length = keep_len;
-                curr->start = 0;
+                // 对于非共享节点，直接移动起点，无需 memmove + realloc
+                curr->start += remaining;
+                curr->length -= remaining;
             }
         } else {
             // 删除整个节点
-            if (!curr->is_shared) {
-                free(curr->samples);
-            }
-            free(curr);
             if (prev) {
                 prev->next = curr->next;
             } else {
                 track->head = curr->next;
             }
+            buffer_release(curr->buffer);
+            free(curr);
         }
     }
 
@@ -555,163 +728,569 @@ static double cross_correlation(const int16_t* x, const int16_t* y,
     return sum / sqrt(norm_x * norm_y);
 }
 
-char* tr_identify(struct sound_seg* target, struct sound_seg* ad) {
-    if (!target || !ad || ad->total_length > target->total_length) 
-        return strdup("");
+// Half-open range of positions (window starts, or samples)
+struct window_span {
+    size_t lo;
+    size_t hi;
+};
+
+struct span_list {
+    struct window_span* spans;
+    size_t count;
+    size_t capacity;
+};
+
+static bool span_add(struct span_list* list, size_t lo, size_t hi) {
+    if (lo >= hi) return true;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        struct window_span* grown = realloc(list->spans, capacity * sizeof(*grown));
+        if (!grown) return false;
+        list->spans = grown;
+        list->capacity = capacity;
+    }
+    list->spans[list->count++] = (struct window_span){ lo, hi };
+    return true;
+}
+
+// Collect the zero runs of `track` as sample ranges, adjacent runs merged
+static bool collect_zero_runs(struct sound_seg* track, struct span_list* zeros) {
+    size_t pos = 0;
+    for (struct audio_node* node = track->head; node; node = node->next) {
+        if (!node->buffer && node->fill == 0) {
+            if (zeros->count > 0 && zeros->spans[zeros->count - 1].hi == pos) {
+                zeros->spans[zeros->count - 1].hi += node->length;
+            } else if (!span_add(zeros, pos, pos + node->length)) {
+                return false;
+            }
+        }
+        pos += node->length;
+    }
+    return true;
+}
+
+// A window lying entirely in silence has zero energy, so it correlates to
+// 0 with any ad. If the window starting at `start` is one, store the last
+// such start in that run in `last`. Starts must be queried in increasing
+// order; `cursor` remembers the position in `zeros`.
+static bool in_zero_run(const struct span_list* zeros, size_t* cursor,
+                        size_t start, size_t window, size_t* last) {
+    while (*cursor < zeros->count && zeros->spans[*cursor].hi < start + window) {
+        (*cursor)++;
+    }
+    if (*cursor == zeros->count || zeros->spans[*cursor].lo > start) return false;
+
+    *last = zeros->spans[*cursor].hi - window;
+    return true;
+}
+
+bool tr_identify_each(struct sound_seg* target, struct sound_seg* ad,
+                      tr_match_fn on_match, void* context) {
+    if (!target || !ad || !on_match) return false;
+    if (ad->total_length == 0 || ad->total_length > target->total_length) return true;
 
     // Calculate advertisement's autocorrelation (zero delay)
     int16_t* ad_buffer = malloc(ad->total_length * sizeof(int16_t));
-    if (!ad_buffer) return strdup("");
+    if (!ad_buffer) return false;
     tr_read(ad, 0, ad->total_length, ad_buffer);
 
     double ad_autocorr = cross_correlation(ad_buffer, ad_buffer, 
                                          ad->total_length, ad->total_length, 0);
     double threshold = ad_autocorr * 0.95;
 
-    // Search for advertisement in target
-    char* result = NULL;
-    size_t result_capacity = 256;
-    result = malloc(result_capacity);
-    if (!result) {
-        free(ad_buffer);
-        return strdup("");
-    }
-    result[0] = '\0';
-
     int16_t* target_buffer = malloc(target->total_length * sizeof(int16_t));
     if (!target_buffer) {
         free(ad_buffer);
-        free(result);
-        return strdup("");
+        return false;
     }
     tr_read(target, 0, target->total_length, target_buffer);
 
+    // Silent windows cannot reach a positive threshold
+    struct span_list zeros = {0};
+    if (threshold > 0 && !collect_zero_runs(target, &zeros)) zeros.count = 0;
+    size_t cursor = 0;
+
+    // Search for advertisement in target
     for (size_t i = 0; i <= target->total_length - ad->total_length; i++) {
+        size_t last;
+        if (in_zero_run(&zeros, &cursor, i, ad->total_length, &last)) {
+            i = last;
+            continue;
+        }
+
         double corr = cross_correlation(target_buffer, ad_buffer,
                                       target->total_length, ad->total_length, i);
         
         if (corr >= threshold) {
-            char temp[64];
-            snprintf(temp, sizeof(temp), "%zu, %zu\n", 
-                    i, i + ad->total_length - 1);
-            
-            size_t needed = strlen(result) + strlen(temp) + 1;
-            if (needed > result_capacity) {
-                result_capacity *= 2;
-                char* new_result = realloc(result, result_capacity);
-                if (!new_result) {
-                    free(ad_buffer);
-                    free(target_buffer);
-                    free(result);
-                    return strdup("");
-                }
-                result = new_result;
-            }
-            
-            strcat(result, temp);
+            on_match(context, i, i + ad->total_length - 1);
             i += ad->total_length - 1; // Skip matched portion
         }
     }
 
     free(ad_buffer);
     free(target_buffer);
+    free(zeros.spans);
+    return true;
+}
 
-    // Remove trailing newline (if exists)
-    size_t len = strlen(result);
-    if (len > 0 && result[len - 1] == '\n') {
-        result[len - 1] = '\0';
+// tr_identify output under construction, one "start, end" line per match
+struct match_text {
+    char* text;
+    size_t length;
+    size_t capacity;
+    bool failed;
+};
+
+static void append_match(void* context, size_t start, size_t end) {
+    struct match_text* out = context;
+    if (out->failed) return;
+
+    char temp[64];
+    int n = snprintf(temp, sizeof(temp), "%s%zu, %zu",
+                     out->length ? "\n" : "", start, end);
+    if (out->length + n + 1 > out->capacity) {
+        size_t capacity = (out->length + n + 1) * 2;
+        char* grown = realloc(out->text, capacity);
+        if (!grown) {
+            out->failed = true;
+            return;
+        }
+        out->text = grown;
+        out->capacity = capacity;
     }
+    memcpy(out->text + out->length, temp, n + 1);
+    out->length += n;
+}
 
-    return result;
+char* tr_identify(struct sound_seg* target, struct sound_seg* ad) {
+    struct match_text out = { .text = malloc(256), .capacity = 256 };
+    if (!out.text) return strdup("");
+    out.text[0] = '\0';
+
+    if (!tr_identify_each(target, ad, append_match, &out) || out.failed) {
+        free(out.text);
+        return strdup("");
+    }
+    return out.text;
 }
 
-// Part 3: Complex insertion
-bool tr_insert(struct sound_seg* dest_track, size_t destpos,
-              struct sound_seg* src_track, size_t srcpos, size_t len) {
-    // 基本参数检查
-    if (!dest_track || !src_track || 
-        srcpos + len > src_track->total_length ||
-        destpos > dest_track->total_length) return false;
-    
-    if (len == 0) return true;
+// Incremental identification. Each cached ad keeps the sorted start of
+// every target window whose correlation reaches the threshold; tr_identify's
+// greedy, non-overlapping selection is then replayed over that list. Edits
+// from the target's log drop and shift cached windows and queue the window
+// starts they touched, which are the only ones scored again.
+struct identify_cache {
+    struct sound_seg* ad;
+    int16_t* ad_samples;             // Copy of the ad the windows were scored with
+    size_t ad_length;
+    double threshold;
+    uint64_t ad_generation;
+    uint64_t target_generation;      // Target edits already applied
+    uint64_t epoch;                  // shared_write_epoch at the last refresh
+    size_t* hits;                    // Sorted matching window starts
+    size_t num_hits;
+    size_t hits_capacity;
+};
 
-    // 找到源节点
-    struct audio_node* src_node = src_track->head;
-    size_t src_curr_pos = 0;
+struct identify_session {
+    struct sound_seg* target;
+    struct identify_cache* caches;
+    size_t num_caches;
+    size_t capacity;
+};
 
-    while (src_node && src_curr_pos + src_node->length <= srcpos) {
-        src_curr_pos += src_node->length;
-        src_node = src_node->next;
-    }
+static int compare_spans(const void* a, const void* b) {
+    size_t x = ((const struct window_span*)a)->lo;
+    size_t y = ((const struct window_span*)b)->lo;
+    return (x > y) - (x < y);
+}
 
-    if (!src_node) return false;
+static int compare_positions(const void* a, const void* b) {
+    size_t x = *(const size_t*)a;
+    size_t y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
 
-    // 创建共享节点
-    struct audio_node* shared_node = create_shared_node(src_track, 
-                                                      src_node->start + (srcpos - src_curr_pos),
-                                                      len);
-    if (!shared_node) return false;
-    shared_node->samples = src_node->samples;
+// Map a position across an edit; positions inside the replaced samples
+// collapse to the start (lower bounds) or the end (upper bounds) of the
+// replacement
+static size_t map_position(size_t x, const struct dirty_range* edit, bool upper) {
+    if (x < edit->pos) return x;
+    if (x >= edit->pos + edit->old_length) return x - edit->old_length + edit->new_length;
+    return upper ? edit->pos + edit->new_length : edit->pos;
+}
 
-    // 找到目标位置
-    struct audio_node* dest_curr = dest_track->head;
-    struct audio_node* dest_prev = NULL;
-    size_t dest_curr_pos = 0;
+// Carry cached windows and pending spans across one edit of the target
+static bool apply_edit(struct identify_cache* cache, struct span_list* pending,
+                       const struct dirty_range* edit) {
+    size_t end = edit->pos + edit->old_length;
+    size_t kept = 0;
+    for (size_t i = 0; i < cache->num_hits; i++) {
+        size_t hit = cache->hits[i];
+        if (hit + cache->ad_length > edit->pos && hit < end) continue;
+        cache->hits[kept++] = hit < end ? hit : hit - edit->old_length + edit->new_length;
+    }
+    cache->num_hits = kept;
 
-    while (dest_curr && dest_curr_pos + dest_curr->length <= destpos) {
-        dest_curr_pos += dest_curr->length;
-        dest_prev = dest_curr;
-        dest_curr = dest_curr->next;
+    for (size_t i = 0; i < pending->count; i++) {
+        struct window_span* span = &pending->spans[i];
+        span->lo = map_position(span->lo, edit, false);
+        span->hi = map_position(span->hi, edit, true);
     }
 
-    // 如果插入位置在现有节点内部，需要分割该节点
-    if (dest_curr && dest_curr_pos < destpos) {
-        // 创建新节点存储分割后的后半部分
-        struct audio_node* split_node = malloc(sizeof(struct audio_node));
-        if (!split_node) {
-            free(shared_node);
+    // Every window overlapping the new samples, or straddling the join
+    size_t lo = edit->pos >= cache->ad_length ? edit->pos - cache->ad_length + 1 : 0;
+    return span_add(pending, lo, edit->pos + edit->new_length);
+}
+
+// Score the window starts in `spans` (sorted, disjoint, within range) and
+// merge the matches into the cached list
+static bool rescore(struct identify_cache* cache, struct sound_seg* target,
+                    const struct span_list* spans) {
+    size_t ad_length = cache->ad_length;
+
+    // Drop cached matches that are about to be rescored
+    size_t kept = 0, s = 0;
+    for (size_t i = 0; i < cache->num_hits; i++) {
+        size_t hit = cache->hits[i];
+        while (s < spans->count && spans->spans[s].hi <= hit) s++;
+        if (s < spans->count && spans->spans[s].lo <= hit) continue;
+        cache->hits[kept++] = hit;
+    }
+    cache->num_hits = kept;
+
+    struct span_list zeros = {0};
+    if (cache->threshold > 0 && !collect_zero_runs(target, &zeros)) zeros.count = 0;
+    size_t cursor = 0;
+
+    for (size_t i = 0; i < spans->count; i++) {
+        const struct window_span* span = &spans->spans[i];
+        size_t read_len = span->hi - span->lo + ad_length - 1;
+        int16_t* samples = malloc(read_len * sizeof(int16_t));
+        if (!samples || !tr_read(target, span->lo, read_len, samples)) {
+            free(samples);
+            free(zeros.spans);
             return false;
         }
 
-        // 设置分割节点
-        split_node->samples = dest_curr->samples;
-        split_node->start = dest_curr->start + (destpos - dest_curr_pos);
-        split_node->length = dest_curr->length - (destpos - dest_curr_pos);
-        split_node->is_shared = dest_curr->is_shared;
-        split_node->owner = dest_curr->owner;
-        split_node->next = dest_curr->next;
+        for (size_t w = 0; w < span->hi - span->lo; w++) {
+            size_t last;
+            if (in_zero_run(&zeros, &cursor, span->lo + w, ad_length, &last)) {
+                w = last - span->lo;
+                continue;
+            }
 
-        // 更新当前节点
-        dest_curr->length = destpos - dest_curr_pos;
-        dest_curr->next = shared_node;
-        shared_node->next = split_node;
-        
-        // 更新指针关系
-        dest_prev = dest_curr;
-        dest_curr = split_node;
-    } else {
-        // 直接插入节点
-        shared_node->next = dest_curr;
-        if (dest_prev) {
-            dest_prev->next = shared_node;
-        } else {
-            dest_track->head = shared_node;
-        }
-    }
+            double corr = cross_correlation(samples, cache->ad_samples,
+                                            read_len, ad_length, w);
+            if (corr < cache->threshold) continue;
 
-    // 创建父子关系节点
-    struct parent_child_node* relation = malloc(sizeof(struct parent_child_node));
-    if (!relation) {
-        // 回滚节点插入
-        if (dest_prev) {
-            dest_prev->next = dest_curr;
+            if (cache->num_hits == cache->hits_capacity) {
+                size_t capacity = cache->hits_capacity ? cache->hits_capacity * 2 : 16;
+                size_t* grown = realloc(cache->hits, capacity * sizeof(*grown));
+                if (!grown) {
+                    free(samples);
+                    free(zeros.spans);
+                    return false;
+                }
+                cache->hits = grown;
+                cache->hits_capacity = capacity;
+            }
+            cache->hits[cache->num_hits++] = span->lo + w;
+        }
+        free(samples);
+    }
+    free(zeros.spans);
+
+    qsort(cache->hits, cache->num_hits, sizeof(size_t), compare_positions);
+    return true;
+}
+
+// Queue the windows over samples of shared nodes that were written in place
+// through another track since `epoch`. Only nodes whose buffer logged such
+// a write are touched; when the buffer's log no longer reaches back to
+// `epoch` the whole node is rescored.
+static bool shared_spans(struct identify_cache* cache, struct sound_seg* target,
+                         struct span_list* pending) {
+    size_t pos = 0;
+    for (struct audio_node* node = target->head; node; pos += node->length, node = node->next) {
+        struct sample_buffer* buf = node->buffer;
+        if (!node->is_shared || !buf || buf->write_count == 0 ||
+            buf->writes[(buf->write_count - 1) % BUFFER_WRITE_LOG].epoch <= cache->epoch) {
+            continue;
+        }
+
+        size_t kept = buf->write_count < BUFFER_WRITE_LOG ? buf->write_count : BUFFER_WRITE_LOG;
+        uint64_t oldest = buf->writes[(buf->write_count - kept) % BUFFER_WRITE_LOG].epoch;
+        bool lost = buf->write_count > BUFFER_WRITE_LOG && oldest > cache->epoch;
+        size_t node_end = node->start + node->length;
+
+        for (size_t i = 0; i < (lost ? 1 : kept); i++) {
+            size_t lo = lost ? node->start : buf->writes[i].start;
+            size_t hi = lost ? node_end : buf->writes[i].end;
+            if (!lost && buf->writes[i].epoch <= cache->epoch) continue;
+            if (lo < node->start) lo = node->start;
+            if (hi > node_end) hi = node_end;
+            if (lo >= hi) continue;
+
+            // Every window overlapping the written samples
+            lo = pos + (lo - node->start);
+            hi = pos + (hi - node->start);
+            if (!span_add(pending, lo >= cache->ad_length ? lo - cache->ad_length + 1 : 0, hi)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Bring the cache up to date with the ad and the target; any step that
+// cannot be done incrementally falls back to scoring every window
+static bool refresh_cache(struct identify_cache* cache, struct sound_seg* target) {
+    struct sound_seg* ad = cache->ad;
+    struct span_list pending = {0};
+    bool full = cache->ad_samples == NULL;
+
+    // Shared-buffer writes elsewhere may have changed the ad; compare content
+    if (!full && (ad->generation != cache->ad_generation ||
+                  cache->epoch != shared_write_epoch)) {
+        int16_t* samples = malloc((ad->total_length ? ad->total_length : 1) * sizeof(int16_t));
+        if (!samples || !tr_read(ad, 0, ad->total_length, samples)) {
+            free(samples);
+            return false;
+        }
+        full = ad->total_length != cache->ad_length ||
+               memcmp(samples, cache->ad_samples, ad->total_length * sizeof(int16_t)) != 0;
+        free(samples);
+    }
+    if (target->generation - cache->target_generation > TR_DIRTY_LOG) full = true;
+
+    if (full) {
+        int16_t* samples = malloc((ad->total_length ? ad->total_length : 1) * sizeof(int16_t));
+        if (!samples || !tr_read(ad, 0, ad->total_length, samples)) {
+            free(samples);
+            return false;
+        }
+        free(cache->ad_samples);
+        cache->ad_samples = samples;
+        cache->ad_length = ad->total_length;
+        cache->threshold = cross_correlation(samples, samples, cache->ad_length,
+                                             cache->ad_length, 0) * 0.95;
+        cache->num_hits = 0;
+        if (!span_add(&pending, 0, target->total_length + 1)) return false;
+    } else {
+        bool ok = true;
+        for (uint64_t g = cache->target_generation + 1; ok && g <= target->generation; g++) {
+            ok = apply_edit(cache, &pending, &target->dirty[g % TR_DIRTY_LOG]);
+        }
+
+        // Windows over samples shared from other tracks may have changed
+        if (ok && cache->epoch != shared_write_epoch) {
+            ok = shared_spans(cache, target, &pending);
+        }
+        if (!ok) {
+            free(pending.spans);
+            return false;
+        }
+    }
+
+    // Clamp to valid window starts, then sort and merge the spans
+    size_t limit = target->total_length >= cache->ad_length ?
+                   target->total_length - cache->ad_length + 1 : 0;
+    if (limit == 0) cache->num_hits = 0;
+    qsort(pending.spans, pending.count, sizeof(struct window_span), compare_spans);
+    size_t merged = 0;
+    for (size_t i = 0; i < pending.count; i++) {
+        struct window_span span = pending.spans[i];
+        if (span.hi > limit) span.hi = limit;
+        if (span.lo >= span.hi) continue;
+        if (merged > 0 && span.lo <= pending.spans[merged - 1].hi) {
+            if (span.hi > pending.spans[merged - 1].hi) pending.spans[merged - 1].hi = span.hi;
+        } else {
+            pending.spans[merged++] = span;
+        }
+    }
+    pending.count = merged;
+
+    bool ok = rescore(cache, target, &pending);
+    free(pending.spans);
+    if (!ok) {
+        // Leave the cache stale so the next refresh starts over
+        free(cache->ad_samples);
+        cache->ad_samples = NULL;
+        return false;
+    }
+
+    cache->ad_generation = ad->generation;
+    cache->target_generation = target->generation;
+    cache->epoch = shared_write_epoch;
+    return true;
+}
+
+struct identify_session* tr_identify_begin(struct sound_seg* target) {
+    if (!target) return NULL;
+
+    struct identify_session* session = calloc(1, sizeof(struct identify_session));
+    if (!session) return NULL;
+    session->target = target;
+    return session;
+}
+
+char* tr_identify_refresh(struct identify_session* session, struct sound_seg* ad) {
+    if (!session || !ad || ad->total_length == 0 ||
+        ad->total_length > session->target->total_length) return strdup("");
+
+    struct identify_cache* cache = NULL;
+    for (size_t i = 0; i < session->num_caches; i++) {
+        if (session->caches[i].ad == ad) cache = &session->caches[i];
+    }
+    if (!cache) {
+        if (session->num_caches == session->capacity) {
+            size_t capacity = session->capacity ? session->capacity * 2 : 4;
+            struct identify_cache* grown = realloc(session->caches, capacity * sizeof(*grown));
+            if (!grown) return strdup("");
+            session->caches = grown;
+            session->capacity = capacity;
+        }
+        cache = &session->caches[session->num_caches++];
+        memset(cache, 0, sizeof(*cache));
+        cache->ad = ad;
+    }
+    if (!refresh_cache(cache, session->target)) return strdup("");
+
+    // Same greedy selection and format as tr_identify
+    struct match_text out = { .text = malloc(256), .capacity = 256 };
+    if (!out.text) return strdup("");
+    out.text[0] = '\0';
+
+    size_t next_free = 0;
+    for (size_t i = 0; i < cache->num_hits; i++) {
+        size_t hit = cache->hits[i];
+        if (hit < next_free) continue;
+        append_match(&out, hit, hit + cache->ad_length - 1);
+        next_free = hit + cache->ad_length;
+    }
+    if (out.failed) {
+        free(out.text);
+        return strdup("");
+    }
+    return out.text;
+}
+
+void tr_identify_end(struct identify_session* session) {
+    if (!session) return;
+
+    for (size_t i = 0; i < session->num_caches; i++) {
+        free(session->caches[i].ad_samples);
+        free(session->caches[i].hits);
+    }
+    free(session->caches);
+    free(session);
+}
+
+// Part 3: Complex insertion
+bool tr_insert(struct sound_seg* dest_track, size_t destpos,
+              struct sound_seg* src_track, size_t srcpos, size_t len) {
+    // 基本参数检查
+    if (!dest_track || !src_track || 
+        srcpos + len > src_track->total_length ||
+        destpos > dest_track->total_length) return false;
+    
+    if (len == 0) return true;
+
+    // 常量段没有缓冲区可共享，先为被插入的部分分配真实样本；
+    // 去重块也要先脱离去重表，父轨道的写入才能原地到达子轨道
+    if (!materialize_range(src_track, srcpos, len) ||
+        !detach_dedup_range(src_track, srcpos, len)) return false;
+
+    // 找到源节点
+    struct audio_node* src_node = src_track->head;
+    size_t src_curr_pos = 0;
+
+    while (src_node && src_curr_pos + src_node->length <= srcpos) {
+        src_curr_pos += src_node->length;
+        src_node = src_node->next;
+    }
+
+    if (!src_node) return false;
+
+    // 为源区间覆盖的每个节点创建共享节点（区间可能跨越多个节点）
+    struct audio_node* chain_head = NULL;
+    struct audio_node* chain_tail = NULL;
+    size_t offset = srcpos - src_curr_pos;
+    size_t remaining = len;
+
+    while (src_node && remaining > 0) {
+        size_t take = src_node->length - offset;
+        if (take > remaining) {
+            take = remaining;
+        }
+
+        struct audio_node* shared_node = create_shared_node(src_track,
+                                                          src_node->start + offset,
+                                                          take);
+        if (!shared_node) {
+            free_node_chain(chain_head);
+            return false;
+        }
+        shared_node->buffer = buffer_retain(src_node->buffer);
+
+        if (chain_tail) {
+            chain_tail->next = shared_node;
         } else {
-            dest_track->head = dest_curr;
+            chain_head = shared_node;
         }
-        free(shared_node);
+        chain_tail = shared_node;
+
+        remaining -= take;
+        offset = 0;
+        src_node = src_node->next;
+    }
+
+    // 先分配父子关系节点，这样后面的链表修改无需回滚
+    struct parent_child_node* relation = malloc(sizeof(struct parent_child_node));
+    struct parent_child_node* child_relation = malloc(sizeof(struct parent_child_node));
+    if (!relation || !child_relation) {
+        free(relation);
+        free(child_relation);
+        free_node_chain(chain_head);
         return false;
     }
 
+    // 找到目标位置
+    struct audio_node* dest_curr = dest_track->head;
+    struct audio_node* dest_prev = NULL;
+    size_t dest_curr_pos = 0;
+
+    while (dest_curr && dest_curr_pos + dest_curr->length <= destpos) {
+        dest_curr_pos += dest_curr->length;
+        dest_prev = dest_curr;
+        dest_curr = dest_curr->next;
+    }
+
+    // 如果插入位置在现有节点内部，需要分割该节点
+    if (dest_curr && dest_curr_pos < destpos) {
+        if (!split_node(dest_curr, destpos - dest_curr_pos)) {
+            free(relation);
+            free(child_relation);
+            free_node_chain(chain_head);
+            return false;
+        }
+        dest_prev = dest_curr;
+        dest_curr = dest_curr->next;
+    }
+
+    // 之后不会再失败，此时才记录编辑，失败的插入不能让会话平移缓存
+    note_edit(dest_track, destpos, 0, len);
+
+    // 插入共享节点链
+    chain_tail->next = dest_curr;
+    if (dest_prev) {
+        dest_prev->next = chain_head;
+    } else {
+        dest_track->head = chain_head;
+    }
+
+    // 创建父子关系节点
     relation->parent = src_track;
     relation->parent_start = srcpos;
     relation->child_start = destpos;
@@ -720,19 +1299,6 @@ bool tr_insert(struct sound_seg* dest_track, size_t destpos,
     dest_track->parents = relation;
 
     // 添加到源轨道的子节点列表
-    struct parent_child_node* child_relation = malloc(sizeof(struct parent_child_node));
-    if (!child_relation) {
-        // 回滚所有更改
-        if (dest_prev) {
-            dest_prev->next = dest_curr;
-        } else {
-            dest_track->head = dest_curr;
-        }
-        free(shared_node);
-        free(relation);
-        return false;
-    }
-
     child_relation->parent = dest_track;
     child_relation->parent_start = srcpos;
     child_relation->child_start = destpos;
@@ -752,7 +1318,8 @@ static struct audio_node* create_shared_node(struct sound_seg* owner,
     struct audio_node* node = malloc(sizeof(struct audio_node));
     if (!node) return NULL;
 
-    node->samples = NULL;  // Will be set by the caller
+    node->buffer = NULL;  // Will be set by the caller
+    node->fill = 0;
     node->start = start;
     node->length = length;
     node->is_shared = true;
@@ -762,6 +1329,454 @@ static struct audio_node* create_shared_node(struct sound_seg* owner,
     return node;
 }
 
+// Helper function to create a node owning a fresh copy of `data`
+static struct audio_node* create_data_node(struct sound_seg* track,
+                                           const int16_t* data, size_t length) {
+    struct audio_node* node = malloc(sizeof(struct audio_node));
+    if (!node) return NULL;
+
+    node->buffer = buffer_create(length, track->ledger);
+    if (!node->buffer) {
+        free(node);
+        return NULL;
+    }
+
+    memcpy(node->buffer->data, data, length * sizeof(int16_t));
+    node->buffer->length = length;
+    node->fill = 0;
+    node->start = 0;
+    node->length = length;
+    node->is_shared = false;
+    node->owner = NULL;
+    node->next = NULL;
+
+    return node;
+}
+
+// Helper function to create a constant-run node
+static struct audio_node* create_run_node(int16_t value, size_t length) {
+    struct audio_node* node = malloc(sizeof(struct audio_node));
+    if (!node) return NULL;
+
+    node->buffer = NULL;
+    node->fill = value;
+    node->start = 0;
+    node->length = length;
+    node->is_shared = false;
+    node->owner = NULL;
+    node->next = NULL;
+
+    return node;
+}
+
+// Number of leading samples of `data` equal to `value`
+static size_t constant_prefix(const int16_t* data, size_t length, int16_t value) {
+    size_t n = 0;
+    while (n < length && data[n] == value) {
+        n++;
+    }
+    return n;
+}
+
+static void fill_samples(int16_t* out, int16_t value, size_t length) {
+    if (value == 0) {
+        memset(out, 0, length * sizeof(int16_t));
+        return;
+    }
+    for (size_t i = 0; i < length; i++) {
+        out[i] = value;
+    }
+}
+
+// Replace the contents of run `node` with `data` (node->length samples), or
+// with its own fill value when `data` is NULL. Long constant data stays a
+// run; anything else gets a private buffer.
+static bool store_in_run(struct sound_seg* track, struct audio_node* node,
+                         const int16_t* data) {
+    if (data && node->length >= RUN_MIN_SAMPLES &&
+        constant_prefix(data, node->length, data[0]) == node->length) {
+        node->fill = data[0];
+        return true;
+    }
+
+    struct sample_buffer* buf = buffer_create(node->length, track->ledger);
+    if (!buf) return false;
+    if (data) {
+        memcpy(buf->data, data, node->length * sizeof(int16_t));
+    } else {
+        fill_samples(buf->data, node->fill, node->length);
+    }
+    buf->length = node->length;
+
+    node->buffer = buf;
+    node->fill = 0;
+    node->start = 0;
+    return true;
+}
+
+// Give every run overlapping [pos, pos + len) real samples for that part,
+// so the range can be shared with another track
+static bool materialize_range(struct sound_seg* track, size_t pos, size_t len) {
+    struct audio_node* node = track->head;
+    size_t node_pos = 0;
+    size_t end = pos + len;
+
+    while (node && node_pos < end) {
+        if (!node->buffer && node_pos + node->length > pos) {
+            if (node_pos < pos) {
+                if (!split_node(node, pos - node_pos)) return false;
+                node_pos = pos;
+                node = node->next;
+            }
+            if (node_pos + node->length > end && !split_node(node, end - node_pos)) {
+                return false;
+            }
+            if (!store_in_run(track, node, NULL)) return false;
+        }
+        node_pos += node->length;
+        node = node->next;
+    }
+    return true;
+}
+
+// Take the blocks under [pos, pos + len) out of deduplication before the
+// range is shared with a child track. Parent writes must then land in place
+// so the child sees them, which a block other dedup users still read cannot
+// allow: such nodes get a private copy first. Afterwards a registered block
+// never has share references, so tr_write's copy-on-write test only sees
+// other dedup users (or our own split nodes).
+static bool detach_dedup_range(struct sound_seg* track, size_t pos, size_t len) {
+    struct audio_node* node = track->head;
+    size_t node_pos = 0;
+    size_t end = pos + len;
+
+    for (; node && node_pos < end; node_pos += node->length, node = node->next) {
+        if (node_pos + node->length <= pos || !node->buffer || !node->buffer->dedup) {
+            continue;
+        }
+        if (node->buffer->refcount == 1) {
+            dedup_forget(node->buffer);
+            continue;
+        }
+
+        // Pinned so allocating the copy cannot page the source out
+        buffer_pin(node->buffer);
+        int16_t* samples = buffer_data(node->buffer);
+        struct audio_node* copy = samples ? create_data_node(track, samples + node->start,
+                                                             node->length) : NULL;
+        buffer_unpin(node->buffer);
+        if (!copy) return false;
+
+        buffer_release(node->buffer);
+        node->buffer = copy->buffer;
+        node->start = 0;
+        free(copy);
+    }
+    return true;
+}
+
+// Link a run of `len` samples of `value` at `pos`, growing a neighbouring
+// run of the same value instead when there is one
+static bool insert_run(struct sound_seg* track, size_t pos, size_t len, int16_t value) {
+    struct audio_node* curr = track->head;
+    struct audio_node* prev = NULL;
+    size_t curr_pos = 0;
+
+    while (curr && curr_pos + curr->length <= pos) {
+        curr_pos += curr->length;
+        prev = curr;
+        curr = curr->next;
+    }
+
+    if (curr && curr_pos < pos) {
+        if (!curr->buffer && curr->fill == value) {
+            curr->length += len;
+            track->total_length += len;
+            return true;
+        }
+        if (!split_node(curr, pos - curr_pos)) return false;
+        prev = curr;
+        curr = curr->next;
+    }
+
+    if (prev && !prev->buffer && prev->fill == value) {
+        prev->length += len;
+    } else if (curr && !curr->buffer && curr->fill == value) {
+        curr->length += len;
+    } else {
+        struct audio_node* node = create_run_node(value, len);
+        if (!node) return false;
+        node->next = curr;
+        if (prev) {
+            prev->next = node;
+        } else {
+            track->head = node;
+        }
+    }
+    track->total_length += len;
+    return true;
+}
+
+// Overwrite [pos, pos + len), which must lie within the track, with `value`
+// the way write_range would: buffers other nodes reference change in place
+// so child tracks see the fill, everything else becomes a run
+static bool fill_in_place(struct sound_seg* track, size_t pos, size_t len, int16_t value) {
+    struct audio_node* curr = track->head;
+    size_t curr_pos = 0;
+
+    while (curr && curr_pos + curr->length <= pos) {
+        curr_pos += curr->length;
+        curr = curr->next;
+    }
+
+    while (len > 0 && curr) {
+        size_t write_offset = pos - curr_pos;
+        size_t write_len = len;
+        if (write_len > curr->length - write_offset) {
+            write_len = curr->length - write_offset;
+        }
+
+        if (curr->buffer && !curr->is_shared && curr->buffer->refcount > 1 &&
+            !curr->buffer->dedup) {
+            // 缓冲区被子轨道共享：原地写入
+            int16_t* samples = buffer_data(curr->buffer);
+            if (!samples) return false;
+            note_buffer_write(curr->buffer, curr->start + write_offset, write_len);
+            fill_samples(samples + curr->start + write_offset, value, write_len);
+            buffer_mark_dirty(curr->buffer);
+        } else if (curr->buffer || curr->fill != value) {
+            // 写入对其他节点不可见：只把被覆盖的部分拆出来改为常量段
+            if (write_offset > 0) {
+                if (!split_node(curr, write_offset)) return false;
+                curr_pos += curr->length;
+                curr = curr->next;
+            }
+            if (write_len < curr->length && !split_node(curr, write_len)) return false;
+            buffer_release(curr->buffer);
+            curr->buffer = NULL;
+            curr->fill = value;
+            curr->start = 0;
+            curr->is_shared = false;
+            curr->owner = NULL;
+        }
+
+        len -= write_len;
+        pos += write_len;
+        curr_pos += curr->length;
+        curr = curr->next;
+    }
+    return true;
+}
+
+bool tr_fill(struct sound_seg* track, size_t pos, size_t len, int16_t value) {
+    if (!track || pos > track->total_length) return false;
+    if (len == 0) return true;
+
+    size_t covered = track->total_length - pos;
+    if (covered > len) covered = len;
+
+    // Child tracks must keep seeing writes to the samples they share
+    bool shared = false;
+    for (struct parent_child_node* child = track->children; child; child = child->next) {
+        if (child->parent_start < pos + covered &&
+            child->parent_start + child->length > pos) {
+            shared = true;
+            break;
+        }
+    }
+
+    size_t old_total = track->total_length;
+    bool ok;
+    if (shared) {
+        ok = fill_in_place(track, pos, covered, value) &&
+             (covered == len || insert_run(track, old_total, len - covered, value));
+    } else {
+        ok = (covered == 0 || remove_range(track, pos, covered)) &&
+             insert_run(track, pos, len, value);
+    }
+    note_change(track, pos, covered, old_total);
+    return ok;
+}
+
+bool tr_insert_silence(struct sound_seg* track, size_t pos, size_t len) {
+    if (!track || pos > track->total_length) return false;
+    if (len == 0) return true;
+
+    if (!insert_run(track, pos, len, 0)) return false;
+    note_edit(track, pos, 0, len);
+    return true;
+}
+
+// Helper function to append after `last` (NULL for an empty track) and
+// account the appended samples in total_length, also on partial failure.
+// Constant stretches of at least RUN_MIN_SAMPLES become runs; the rest is
+// stored by append_data().
+static bool append_samples(struct sound_seg* track, struct audio_node* last,
+                           const int16_t* data, size_t length) {
+    // Samples continuing a run at the tail just lengthen it
+    if (last && !last->buffer) {
+        size_t n = constant_prefix(data, length, last->fill);
+        last->length += n;
+        track->total_length += n;
+        data += n;
+        length -= n;
+    }
+
+    while (length > 0) {
+        size_t plain = 0;
+        size_t run = 0;
+        while (plain < length) {
+            run = constant_prefix(data + plain, length - plain, data[plain]);
+            if (run >= RUN_MIN_SAMPLES) break;
+            plain += run;
+        }
+
+        if (plain > 0) {
+            if (!append_data(track, last, data, plain)) return false;
+            last = last ? last : track->head;
+            while (last->next) {
+                last = last->next;
+            }
+            data += plain;
+            length -= plain;
+        }
+
+        if (length > 0) {
+            struct audio_node* node = create_run_node(data[0], run);
+            if (!node) return false;
+            if (last) {
+                last->next = node;
+            } else {
+                track->head = node;
+            }
+            last = node;
+            track->total_length += run;
+            data += run;
+            length -= run;
+        }
+    }
+    return true;
+}
+
+// Append samples as buffer-backed nodes. A private tail node that ends at
+// the end of its buffer is extended in place, growing the buffer
+// geometrically, so small appends amortize to a memcpy.
+static bool append_data(struct sound_seg* track, struct audio_node* last,
+                        const int16_t* data, size_t length) {
+    // 启用去重时，完整的块交给去重层，余下部分按普通方式追加
+    size_t block = dedup_block_size();
+    while (block > 0 && length >= block) {
+        struct audio_node* node = malloc(sizeof(struct audio_node));
+        if (!node) return false;
+
+        node->buffer = dedup_acquire(data, block, track->ledger);
+        if (!node->buffer) {
+            free(node);
+            return false;
+        }
+        node->fill = 0;
+        node->start = 0;
+        node->length = block;
+        node->is_shared = false;
+        node->owner = NULL;
+        node->next = NULL;
+
+        if (last) {
+            last->next = node;
+        } else {
+            track->head = node;
+        }
+        last = node;
+        data += block;
+        length -= block;
+        track->total_length += block;
+    }
+    if (length == 0) return true;
+
+    if (last && last->buffer && !last->is_shared && !last->buffer->dedup &&
+        last->start + last->length == last->buffer->length) {
+        struct sample_buffer* buf = last->buffer;
+        size_t needed = buf->length + length;
+
+        if (needed > buf->capacity && needed <= TAIL_MAX_SAMPLES) {
+            size_t capacity = buf->capacity * 2;
+            if (capacity < needed) capacity = needed;
+            if (capacity > TAIL_MAX_SAMPLES) capacity = TAIL_MAX_SAMPLES;
+            if (!buffer_resize(buf, capacity)) return false;
+        }
+
+        if (needed <= buf->capacity) {
+            int16_t* samples = buffer_data(buf);
+            if (!samples) return false;
+            memcpy(samples + buf->length, data, length * sizeof(int16_t));
+            buf->length = needed;
+            buffer_mark_dirty(buf);
+            last->length += length;
+            track->total_length += length;
+            return true;
+        }
+    }
+
+    struct audio_node* new_node = create_data_node(track, data, length);
+    if (!new_node) return false;
+
+    if (last) {
+        last->next = new_node;
+    } else {
+        track->head = new_node;
+    }
+    track->total_length += length;
+    return true;
+}
+
+// Record a mutating call in the track's edit log; the ring keeps the last
+// TR_DIRTY_LOG edits, older ones force identify sessions to rescan
+static void note_edit(struct sound_seg* track, size_t pos,
+                      size_t old_length, size_t new_length) {
+    track->generation++;
+    struct dirty_range* range = &track->dirty[track->generation % TR_DIRTY_LOG];
+    range->pos = pos;
+    range->old_length = old_length;
+    range->new_length = new_length;
+}
+
+// Log an edit of `old_length` samples at `pos` after it ran, sized by how
+// much the track actually grew or shrank; a call that failed part way is
+// thus recorded as what it did rather than what it was asked to do
+static void note_change(struct sound_seg* track, size_t pos,
+                        size_t old_length, size_t old_total) {
+    note_edit(track, pos, old_length, old_length + track->total_length - old_total);
+}
+
+// Log an in-place write of [start, start + len) to `buf` when other nodes
+// reference it, for identify sessions to rescore (see shared_spans). A write
+// continuing the buffer's newest entry extends it rather than using a slot.
+static void note_buffer_write(struct sample_buffer* buf, size_t start, size_t len) {
+    if (buf->refcount <= 1) return;
+
+    struct buffer_write* w = NULL;
+    if (buf->write_count > 0) {
+        w = &buf->writes[(buf->write_count - 1) % BUFFER_WRITE_LOG];
+        if (w->end != start) w = NULL;
+    }
+    if (!w) {
+        w = &buf->writes[buf->write_count++ % BUFFER_WRITE_LOG];
+        w->start = start;
+    }
+    w->epoch = ++shared_write_epoch;
+    w->end = start + len;
+}
+
+// Helper function to free a list of nodes and drop their buffer references
+static void free_node_chain(struct audio_node* node) {
+    while (node) {
+        struct audio_node* next = node->next;
+        buffer_release(node->buffer);
+        free(node);
+        node = next;
+    }
+}
+
 // Part 4: Cleanup
 void tr_resolve(struct sound_seg** tracks, size_t num_tracks) {
     if (!tracks || num_tracks == 0) return;
@@ -830,4 +1845,60 @@ void tr_resolve(struct sound_seg** tracks, size_t num_tracks) {
             }
         }
     }
-} 
\ No newline at end of file
+}
+
+// Memory accounting
+static int compare_buffers(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(struct sample_buffer* const*)a;
+    uintptr_t y = (uintptr_t)*(struct sample_buffer* const*)b;
+    return (x > y) - (x < y);
+}
+
+bool tr_memory_usage(struct sound_seg* track, struct tr_memory_usage* usage) {
+    if (!track || !usage) return false;
+    memset(usage, 0, sizeof(*usage));
+
+    size_t num_nodes = 0;
+    for (struct audio_node* node = track->head; node; node = node->next) {
+        num_nodes++;
+    }
+
+    // 私有节点可能共用同一个缓冲区（分割产生），去重后再统计容量
+    struct sample_buffer** owned = malloc((num_nodes ? num_nodes : 1) * sizeof(*owned));
+    if (!owned) return false;
+
+    size_t num_owned = 0;
+    size_t live_bytes = 0;
+    for (struct audio_node* node = track->head; node; node = node->next) {
+        usage->node_bytes += sizeof(struct audio_node);
+        if (!node->buffer) {
+            usage->run_bytes += node->length * sizeof(int16_t);
+        } else if (node->is_shared) {
+            usage->shared_in_bytes += node->length * sizeof(int16_t);
+        } else {
+            owned[num_owned++] = node->buffer;
+            live_bytes += node->length * sizeof(int16_t);
+        }
+    }
+
+    qsort(owned, num_owned, sizeof(*owned), compare_buffers);
+    for (size_t i = 0; i < num_owned; i++) {
+        if (i > 0 && owned[i] == owned[i - 1]) continue;
+        usage->owned_bytes += owned[i]->capacity * sizeof(int16_t);
+    }
+    free(owned);
+
+    for (struct parent_child_node* rel = track->parents; rel; rel = rel->next) {
+        usage->relation_bytes += sizeof(struct parent_child_node);
+    }
+    for (struct parent_child_node* rel = track->children; rel; rel = rel->next) {
+        usage->relation_bytes += sizeof(struct parent_child_node);
+        usage->shared_out_bytes += rel->length * sizeof(int16_t);
+    }
+
+    usage->allocated_bytes = track->ledger->allocated;
+    if (usage->owned_bytes > live_bytes) {
+        usage->fragmentation = 1.0 - (double)live_bytes / (double)usage->owned_bytes;
+    }
+    return true;
+}
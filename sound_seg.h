@@ -5,9 +5,54 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-// Audio segment node structure for linked storage
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mapped_file;
+struct memory_ledger;
+
+// One in-place write to a buffer other nodes also reference: samples
+// [start, end) of the buffer changed at `epoch` of the shared-write clock
+struct buffer_write {
+    uint64_t epoch;
+    size_t start;
+    size_t end;
+};
+
+// Shared writes each buffer remembers for incremental identification
+#define BUFFER_WRITE_LOG 4
+
+// Reference-counted sample storage, shared by every node that slices it.
+// The page cache may evict the data to the spill file, so always access it
+// through buffer_data() (see page_cache.h) rather than caching the pointer.
+struct sample_buffer {
+    int16_t* data;                   // Resident samples, NULL while paged out
+    size_t length;                   // Number of valid samples
+    size_t capacity;                 // Number of allocated samples
+    size_t refcount;                 // Number of nodes referencing this buffer
+    size_t pins;                     // Active pins that prevent eviction
+    bool dirty;                      // Resident copy differs from the spill copy
+    bool spilled;                    // A copy exists in the spill file
+    long long spill_offset;          // Byte offset of the spill slot
+    size_t spill_capacity;           // Samples reserved in the spill slot
+    const int16_t* backing;          // Read-only source while never spilled
+    struct mapped_file* mapping;     // Keeps `backing` mapped (project files)
+    struct memory_ledger* ledger;    // Budget the allocation is charged to
+    bool dedup;                      // Registered in the dedup table
+    uint64_t dedup_hash;             // Content hash while registered
+    struct sample_buffer* dedup_next; // Dedup hash chain
+    struct sample_buffer* lru_prev;  // More recently used resident buffer
+    struct sample_buffer* lru_next;  // Less recently used resident buffer
+    uint64_t write_count;            // Shared writes so far
+    struct buffer_write writes[BUFFER_WRITE_LOG]; // Write n is kept at [n % BUFFER_WRITE_LOG]
+};
+
+// Audio segment node structure for linked storage. A node without a buffer
+// is a constant run: `length` samples of `fill` that take no storage.
 struct audio_node {
-    int16_t* samples;        // Pointer to actual audio data
+    struct sample_buffer* buffer; // Backing sample storage, NULL for a run
+    int16_t fill;           // Sample value of a constant run
     size_t start;           // Starting position in original data
     size_t length;          // Number of samples in this node
     bool is_shared;         // Whether this node's data is shared from another track
@@ -24,12 +69,25 @@ struct parent_child_node {
     struct parent_child_node* next;
 };
 
+// One mutating call: old_length samples at pos became new_length samples
+struct dirty_range {
+    size_t pos;
+    size_t old_length;
+    size_t new_length;
+};
+
+// Recent edits each track remembers for incremental identification
+#define TR_DIRTY_LOG 32
+
 // Main track structure
 struct sound_seg {
     struct audio_node* head;          // Head of audio data linked list
     struct parent_child_node* children; // List of tracks that share our data
     struct parent_child_node* parents;  // List of tracks we share data from
     size_t total_length;               // Total number of samples
+    struct memory_ledger* ledger;      // Bytes allocated on behalf of this track
+    uint64_t generation;               // Number of mutating calls so far
+    struct dirty_range dirty[TR_DIRTY_LOG]; // Edit g is kept at [g % TR_DIRTY_LOG]
 };
 
 // Part 1: WAV file interaction and basic sound operations
@@ -42,9 +100,30 @@ bool tr_read(struct sound_seg* track, size_t pos, size_t len, int16_t* buffer);
 bool tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* buffer);
 bool tr_delete_range(struct sound_seg* track, size_t pos, size_t len);
 
+// Samples of a buffer-backed node, faulted back in if they were paged out.
+// The pointer is valid until the next call that may evict (any track call).
+// NULL for a constant run (see node->fill) or if the samples cannot be read.
+const int16_t* tr_node_samples(const struct audio_node* node);
+
 // Part 2: Advertisement identification
 char* tr_identify(struct sound_seg* target, struct sound_seg* ad);
 
+// Report each match tr_identify would list, in order, without building a
+// string. `end` is the last sample of the match. Returns false if the
+// scan could not run (allocation failure); matches reported so far stand.
+typedef void (*tr_match_fn)(void* context, size_t start, size_t end);
+bool tr_identify_each(struct sound_seg* target, struct sound_seg* ad,
+                      tr_match_fn on_match, void* context);
+
+// Incremental identification. A session caches, per ad, every matching
+// window of the target; a refresh rescores only windows overlapping ranges
+// edited since the previous refresh and returns the tr_identify result.
+// End the session before destroying the tracks it was used with.
+struct identify_session;
+struct identify_session* tr_identify_begin(struct sound_seg* target);
+char* tr_identify_refresh(struct identify_session* session, struct sound_seg* ad);
+void tr_identify_end(struct identify_session* session);
+
 // Part 3: Complex insertion
 bool tr_insert(struct sound_seg* dest_track, size_t destpos,
               struct sound_seg* src_track, size_t srcpos, size_t len);
@@ -52,4 +131,118 @@ bool tr_insert(struct sound_seg* dest_track, size_t destpos,
 // Part 4: Cleanup [COMP9017]
 void tr_resolve(struct sound_seg** tracks, size_t num_tracks);
 
+// Constant runs. tr_fill sets [pos, pos + len) to `value`, extending the
+// track if the range runs past its end; tr_insert_silence inserts `len`
+// zero samples at `pos`. Both store runs without sample buffers. Samples
+// other tracks share from us are overwritten in place instead.
+bool tr_fill(struct sound_seg* track, size_t pos, size_t len, int16_t value);
+bool tr_insert_silence(struct sound_seg* track, size_t pos, size_t len);
+
+// Streaming WAV I/O with 64-bit sizes. Files whose data exceeds the 32-bit
+// RIFF limits are read and written as RF64 (ds64 chunk); samples move in
+// bounded chunks, appended to / read from the track, so memory stays flat.
+bool tr_load_wav(struct sound_seg* track, const char* filename);
+bool tr_save_wav(struct sound_seg* track, const char* filename);
+
+// Paging: keep resident sample memory under a budget by spilling cold
+// buffers to disk and faulting them back in on access. A spill_path must
+// not exist yet; it is created and unlinked at once, NULL uses $TMPDIR.
+struct tr_pager_stats {
+    size_t budget_bytes;     // Resident budget (0 = unlimited)
+    size_t resident_bytes;   // Sample bytes currently in memory
+    size_t spilled_bytes;    // Sample bytes reserved in the spill file
+    size_t faults;           // Buffers read back from the spill file on demand
+    size_t prefetches;       // Buffers read back ahead of access
+    size_t evictions;        // Buffers dropped from memory
+};
+
+bool tr_pager_configure(const char* spill_path, size_t budget_bytes,
+                        size_t prefetch_samples);
+void tr_pager_stats(struct tr_pager_stats* stats);
+
+// Memory accounting. Owned bytes are the capacity of buffers referenced by
+// the track's private nodes; fragmentation is the fraction of those bytes
+// the track's nodes no longer reach (trimmed fronts, tail spare capacity).
+struct tr_memory_usage {
+    size_t owned_bytes;          // Capacity of buffers this track owns
+    size_t shared_in_bytes;      // Sample bytes borrowed from other tracks
+    size_t shared_out_bytes;     // Sample bytes other tracks borrow from us
+    size_t run_bytes;            // Sample bytes held as constant runs (no storage)
+    size_t node_bytes;           // audio_node overhead
+    size_t relation_bytes;       // parent_child_node overhead
+    size_t allocated_bytes;      // Bytes charged against the track budget
+    double fragmentation;        // Unreachable share of owned_bytes (0..1)
+};
+
+bool tr_memory_usage(struct sound_seg* track, struct tr_memory_usage* usage);
+
+// Budgets (0 = unlimited). When an allocation would exceed a budget the hook
+// is called with the charged track (NULL if destroyed) and the request size;
+// it may free memory elsewhere and return true to retry, or return false to
+// make the allocating call fail. The hook must not modify `track`.
+typedef bool (*tr_budget_hook)(struct sound_seg* track, size_t requested_bytes,
+                               void* user_data);
+
+void tr_set_budget(struct sound_seg* track, size_t budget_bytes);
+void tr_set_global_budget(size_t budget_bytes);
+void tr_set_budget_hook(tr_budget_hook hook, void* user_data);
+
+// Content-addressed deduplication (opt-in). New data written by tr_write,
+// including loaded files, is cut into fixed blocks; blocks identical to a
+// registered one share its buffer and are copied on write. Stats are
+// cumulative since start-up, except the unique block counts.
+struct tr_dedup_stats {
+    size_t unique_blocks;        // Blocks currently registered
+    size_t unique_bytes;         // Sample bytes of registered blocks
+    size_t bytes_written;        // Bytes that went through deduplication
+    size_t bytes_stored;         // Bytes that needed a new block
+    size_t bytes_saved;          // bytes_written - bytes_stored
+    size_t hits;                 // Blocks served from the table
+};
+
+void tr_dedup_configure(bool enabled, size_t block_samples);
+void tr_dedup_stats(struct tr_dedup_stats* stats);
+
+// Batch WAV ingest/export through a thread pool. Reading and parsing
+// (ingest) or writing (export) run on worker threads while tracks are
+// built or flattened on the calling thread; data held between the stages
+// is bounded by max_inflight_bytes. Each file gets its own result.
+struct wav_batch_options {
+    size_t threads;              // Worker threads (0 = online CPUs)
+    size_t max_inflight_bytes;   // Bound on buffered file data (0 = 64 MiB)
+};
+
+struct wav_batch_result {
+    struct sound_seg* track;     // Loaded track (ingest only, caller owns it)
+    bool ok;
+    char error[128];
+};
+
+bool wav_load_batch(const char** filenames, size_t count,
+                    const struct wav_batch_options* options,
+                    struct wav_batch_result* results);
+bool wav_save_batch(const char** filenames, struct sound_seg** tracks, size_t count,
+                    const struct wav_batch_options* options,
+                    struct wav_batch_result* results);
+
+// Project files: every track with its nodes, shared buffers (stored once)
+// and parent/child relationships. Opening maps the file and builds tracks
+// on first access; sample data is only read when it is touched.
+// Tracks returned by proj_track() are owned by the caller (tr_destroy),
+// so each index is returned once and later calls for it return NULL;
+// tracks built only because a requested one refers to them are destroyed
+// by proj_close() unless they were requested too. proj_save() replaces
+// the file atomically, so saving over a project that is still open is safe.
+struct sound_project;
+
+bool proj_save(const char* filename, struct sound_seg** tracks, size_t num_tracks);
+struct sound_project* proj_open(const char* filename);
+size_t proj_track_count(struct sound_project* project);
+struct sound_seg* proj_track(struct sound_project* project, size_t index);
+void proj_close(struct sound_project* project);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // SOUND_SEG_H 
\ No newline at end of file
@@ -0,0 +1,194 @@
+#ifndef SOUND_SEG_HPP
+#define SOUND_SEG_HPP
+
+// C++20 façade over the track API. Everything is inline and forwards to the
+// C functions: reads and writes go straight to/from the caller's span, and
+// node views point into the library's own buffers, so C++ callers pay no
+// copies or allocations beyond what the C calls already do.
+
+#include "sound_seg.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace soundseg {
+
+// One identified advertisement, both ends inclusive as in tr_identify
+struct Match {
+    std::size_t start;
+    std::size_t end;
+
+    friend bool operator==(const Match&, const Match&) = default;
+};
+
+// One node of a track. Buffer-backed nodes expose their samples in place;
+// constant runs have no storage and report their value instead.
+struct NodeSpan {
+    std::span<const int16_t> samples; // Empty for a run
+    std::size_t length;
+    int16_t fill;                     // Value of every sample of a run
+    bool run;
+};
+
+// Iterates the samples of a track node by node without copying. A span is
+// valid until the next call into the library, which may move or page out
+// the buffer behind it. Dereferencing throws std::runtime_error when a
+// paged-out node cannot be read back.
+class NodeIterator {
+public:
+    using value_type = NodeSpan;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::forward_iterator_tag;
+
+    NodeIterator() noexcept = default;
+    explicit NodeIterator(const audio_node* node) noexcept : node_(node) {}
+
+    value_type operator*() const {
+        if (!node_->buffer) return { {}, node_->length, node_->fill, true };
+
+        // tr_node_samples() faults paged-out samples back in
+        const int16_t* samples = tr_node_samples(node_);
+        if (!samples) throw std::runtime_error("soundseg: cannot read node samples");
+        return { { samples, node_->length }, node_->length, 0, false };
+    }
+
+    NodeIterator& operator++() noexcept {
+        node_ = node_->next;
+        return *this;
+    }
+
+    NodeIterator operator++(int) noexcept {
+        NodeIterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    friend bool operator==(const NodeIterator&, const NodeIterator&) = default;
+    friend bool operator==(const NodeIterator& it, std::default_sentinel_t) noexcept {
+        return it.node_ == nullptr;
+    }
+
+private:
+    const audio_node* node_ = nullptr;
+};
+
+class NodeRange {
+public:
+    explicit NodeRange(const sound_seg* track) noexcept : track_(track) {}
+
+    // An empty (released or moved-from) Track yields an empty range
+    NodeIterator begin() const noexcept { return NodeIterator(track_ ? track_->head : nullptr); }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    const sound_seg* track_;
+};
+
+// Move-only owner of a sound_seg*. Operations mirror the C API and report
+// failure the same way, by returning false; those that return a value
+// instead throw std::bad_alloc, like the constructor.
+class Track {
+public:
+    Track() : seg_(tr_init()) {
+        if (!seg_) throw std::bad_alloc();
+    }
+
+    // Adopt a track created by the C API (e.g. proj_track)
+    explicit Track(sound_seg* adopted) noexcept : seg_(adopted) {}
+
+    Track(const Track&) = delete;
+    Track& operator=(const Track&) = delete;
+
+    Track(Track&& other) noexcept : seg_(std::exchange(other.seg_, nullptr)) {}
+
+    Track& operator=(Track&& other) noexcept {
+        if (this != &other) {
+            tr_destroy(seg_);
+            seg_ = std::exchange(other.seg_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Track() { tr_destroy(seg_); }
+
+    sound_seg* get() const noexcept { return seg_; }
+    sound_seg* release() noexcept { return std::exchange(seg_, nullptr); }
+    explicit operator bool() const noexcept { return seg_ != nullptr; }
+
+    std::size_t size() const noexcept { return tr_length(seg_); }
+
+    [[nodiscard]] bool read(std::size_t pos, std::span<int16_t> out) const noexcept {
+        return tr_read(seg_, pos, out.size(), out.data());
+    }
+
+    [[nodiscard]] bool write(std::size_t pos, std::span<const int16_t> samples) noexcept {
+        return tr_write(seg_, pos, samples.size(), samples.data());
+    }
+
+    [[nodiscard]] bool erase(std::size_t pos, std::size_t len) noexcept {
+        return tr_delete_range(seg_, pos, len);
+    }
+
+    // Sets [pos, pos+len) to `value` as a constant run, extending the track if needed
+    [[nodiscard]] bool fill(std::size_t pos, std::size_t len, int16_t value) noexcept {
+        return tr_fill(seg_, pos, len, value);
+    }
+
+    // Inserts `len` zero samples at `pos`
+    [[nodiscard]] bool insert_silence(std::size_t pos, std::size_t len) noexcept {
+        return tr_insert_silence(seg_, pos, len);
+    }
+
+    // Shares samples with `src`, which records the relationship
+    [[nodiscard]] bool insert(std::size_t destpos, Track& src,
+                              std::size_t srcpos, std::size_t len) noexcept {
+        return tr_insert(seg_, destpos, src.seg_, srcpos, len);
+    }
+
+    [[nodiscard]] bool load_wav(const char* filename) noexcept {
+        return tr_load_wav(seg_, filename);
+    }
+
+    [[nodiscard]] bool save_wav(const char* filename) const noexcept {
+        return tr_save_wav(seg_, filename);
+    }
+
+    std::vector<Match> identify(const Track& ad) const {
+        if (!seg_ || !ad.seg_) return {};    // Moved-from tracks match nothing
+
+        // Exceptions must not unwind through the C scan, so a failed
+        // push_back is remembered and reported once the scan returns
+        struct Collector {
+            std::vector<Match> matches;
+            bool failed = false;
+        } collector;
+
+        bool ok = tr_identify_each(seg_, ad.seg_, [](void* context, std::size_t start,
+                                                     std::size_t end) {
+            auto* c = static_cast<Collector*>(context);
+            if (c->failed) return;
+            try {
+                c->matches.push_back({ start, end });
+            } catch (const std::bad_alloc&) {
+                c->failed = true;
+            }
+        }, &collector);
+        if (!ok || collector.failed) throw std::bad_alloc();
+        return std::move(collector.matches);
+    }
+
+    NodeRange nodes() const noexcept { return NodeRange(seg_); }
+
+private:
+    sound_seg* seg_;
+};
+
+} // namespace soundseg
+
+#endif // SOUND_SEG_HPP
@@ -0,0 +1,89 @@
+// Tests for the C++ header (sound_seg.hpp); run with `make test`
+
+#include "sound_seg.hpp"
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static void test_nodes() {
+    soundseg::Track t;
+    std::vector<int16_t> samples(5000);
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        samples[i] = static_cast<int16_t>(i % 2000) - 1000;
+    }
+    CHECK(t.write(0, samples));
+    CHECK(t.insert_silence(0, 4096));
+
+    std::size_t total = 0;
+    bool runs = false;
+    for (const auto& node : t.nodes()) {
+        total += node.length;
+        runs = runs || node.run;
+        if (!node.run) CHECK(node.samples.size() == node.length);
+    }
+    CHECK(total == t.size());
+    CHECK(runs);
+}
+
+static void test_identify() {
+    soundseg::Track t, ad;
+    std::vector<int16_t> samples(5000);
+    unsigned seed = 12345;
+    for (auto& sample : samples) {
+        seed = seed * 1103515245 + 12345;
+        sample = static_cast<int16_t>((seed >> 8) % 2000) - 1000;
+    }
+    CHECK(t.write(0, samples));
+    CHECK(ad.write(0, std::span<const int16_t>(samples).subspan(1000, 300)));
+
+    auto matches = t.identify(ad);
+    CHECK(matches.size() == 1);
+    CHECK(!matches.empty() && matches[0] == (soundseg::Match{ 1000, 1299 }));
+}
+
+static void test_moved_from() {
+    soundseg::Track a, ad;
+    std::vector<int16_t> samples(100, 5);
+    CHECK(a.write(0, samples));
+    CHECK(ad.write(0, std::span<const int16_t>(samples).first(10)));
+
+    soundseg::Track b = std::move(a);
+    CHECK(!a);
+    CHECK(a.size() == 0);
+    CHECK(a.identify(ad).empty());
+    CHECK(!b.identify(ad).empty());
+
+    std::size_t count = 0;
+    for (const auto& node : a.nodes()) {
+        (void)node;
+        count++;
+    }
+    CHECK(count == 0);
+
+    soundseg::Track c;
+    tr_destroy(c.release());
+    CHECK(c.nodes().begin() == std::default_sentinel);
+}
+
+int main() {
+    test_nodes();
+    test_identify();
+    test_moved_from();
+
+    if (failures) {
+        std::printf("test_cpp: %d failure(s)\n", failures);
+        return 1;
+    }
+    std::printf("test_cpp: all tests passed\n");
+    return 0;
+}
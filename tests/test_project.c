@@ -0,0 +1,114 @@
+// Tests for project files (proj_*); run with `make test`
+
+#include "sound_seg.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define PROJECT_FILE "tests/test_project.proj"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Track 0 holds 4000 samples, track 1 shares 500 of them
+static bool save_project(void) {
+    struct sound_seg* parent = tr_init();
+    struct sound_seg* child = tr_init();
+    int16_t samples[4000];
+    for (int i = 0; i < 4000; i++) {
+        samples[i] = (int16_t)(i * 7);
+    }
+
+    bool ok = parent && child &&
+              tr_write(parent, 0, 4000, samples) &&
+              tr_insert(child, 0, parent, 100, 500);
+    struct sound_seg* tracks[2] = { parent, child };
+    ok = ok && proj_save(PROJECT_FILE, tracks, 2);
+    tr_destroy(child);
+    tr_destroy(parent);
+    return ok;
+}
+
+static void test_round_trip(void) {
+    struct sound_project* project = proj_open(PROJECT_FILE);
+    CHECK(project);
+    if (!project) return;
+    CHECK(proj_track_count(project) == 2);
+
+    struct sound_seg* parent = proj_track(project, 0);
+    struct sound_seg* child = proj_track(project, 1);
+    CHECK(parent && tr_length(parent) == 4000);
+    CHECK(child && tr_length(child) == 500);
+
+    int16_t sample = 0;
+    CHECK(child && tr_read(child, 0, 1, &sample) && sample == 700);
+
+    proj_close(project);
+    tr_destroy(child);
+    tr_destroy(parent);
+}
+
+// Every track is handed out once, so one tr_destroy per returned track is
+// always right; asking again must not return the same pointer
+static void test_track_returned_once(void) {
+    struct sound_project* project = proj_open(PROJECT_FILE);
+    CHECK(project);
+    if (!project) return;
+
+    struct sound_seg* parent = proj_track(project, 0);
+    CHECK(parent);
+    CHECK(proj_track(project, 0) == NULL);
+
+    // The child's parent was already built; the child itself was not yet returned
+    struct sound_seg* child = proj_track(project, 1);
+    CHECK(child);
+    CHECK(proj_track(project, 1) == NULL);
+    CHECK(proj_track(project, 2) == NULL);
+
+    proj_close(project);
+    tr_destroy(child);
+    tr_destroy(parent);
+}
+
+// A track built only because a requested one refers to it stays with the
+// project until it is requested itself
+static void test_implicit_track_returned_once(void) {
+    struct sound_project* project = proj_open(PROJECT_FILE);
+    CHECK(project);
+    if (!project) return;
+
+    struct sound_seg* child = proj_track(project, 1);
+    CHECK(child);
+    struct sound_seg* parent = proj_track(project, 0);
+    CHECK(parent);
+    CHECK(proj_track(project, 0) == NULL);
+
+    proj_close(project);
+    tr_destroy(child);
+    tr_destroy(parent);
+}
+
+int main(void) {
+    if (!save_project()) {
+        printf("test_project: cannot save " PROJECT_FILE "\n");
+        return 1;
+    }
+
+    test_round_trip();
+    test_track_returned_once();
+    test_implicit_track_returned_once();
+    unlink(PROJECT_FILE);
+
+    if (failures) {
+        printf("test_project: %d failure(s)\n", failures);
+        return 1;
+    }
+    printf("test_project: all tests passed\n");
+    return 0;
+}
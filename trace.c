@@ -0,0 +1,611 @@
+#include "trace.h"
+#include "sound_seg.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Link-time wrappers (-Wl,--wrap=NAME) around the public API in sound_seg.h.
+// __real_NAME resolves to the library function, callers reach __wrap_NAME.
+
+int16_t* __real_wav_load(const char* filename, size_t* length);
+bool __real_wav_save(const char* filename, int16_t* samples, size_t length);
+struct sound_seg* __real_tr_init(void);
+void __real_tr_destroy(struct sound_seg* track);
+size_t __real_tr_length(struct sound_seg* track);
+bool __real_tr_read(struct sound_seg* track, size_t pos, size_t len, int16_t* buffer);
+bool __real_tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* buffer);
+bool __real_tr_delete_range(struct sound_seg* track, size_t pos, size_t len);
+char* __real_tr_identify(struct sound_seg* target, struct sound_seg* ad);
+bool __real_tr_identify_each(struct sound_seg* target, struct sound_seg* ad,
+                             tr_match_fn on_match, void* context);
+bool __real_tr_insert(struct sound_seg* dest_track, size_t destpos,
+                      struct sound_seg* src_track, size_t srcpos, size_t len);
+void __real_tr_resolve(struct sound_seg** tracks, size_t num_tracks);
+bool __real_tr_fill(struct sound_seg* track, size_t pos, size_t len, int16_t value);
+bool __real_tr_insert_silence(struct sound_seg* track, size_t pos, size_t len);
+bool __real_tr_load_wav(struct sound_seg* track, const char* filename);
+bool __real_tr_save_wav(struct sound_seg* track, const char* filename);
+struct identify_session* __real_tr_identify_begin(struct sound_seg* target);
+char* __real_tr_identify_refresh(struct identify_session* session, struct sound_seg* ad);
+void __real_tr_identify_end(struct identify_session* session);
+bool __real_tr_pager_configure(const char* spill_path, size_t budget_bytes,
+                               size_t prefetch_samples);
+void __real_tr_pager_stats(struct tr_pager_stats* stats);
+void __real_tr_dedup_configure(bool enabled, size_t block_samples);
+void __real_tr_dedup_stats(struct tr_dedup_stats* stats);
+void __real_tr_set_budget(struct sound_seg* track, size_t budget_bytes);
+void __real_tr_set_global_budget(size_t budget_bytes);
+void __real_tr_set_budget_hook(tr_budget_hook hook, void* user_data);
+bool __real_tr_memory_usage(struct sound_seg* track, struct tr_memory_usage* usage);
+bool __real_proj_save(const char* filename, struct sound_seg** tracks, size_t num_tracks);
+struct sound_project* __real_proj_open(const char* filename);
+size_t __real_proj_track_count(struct sound_project* project);
+struct sound_seg* __real_proj_track(struct sound_project* project, size_t index);
+void __real_proj_close(struct sound_project* project);
+bool __real_wav_load_batch(const char** filenames, size_t count,
+                           const struct wav_batch_options* options,
+                           struct wav_batch_result* results);
+bool __real_wav_save_batch(const char** filenames, struct sound_seg** tracks, size_t count,
+                           const struct wav_batch_options* options,
+                           struct wav_batch_result* results);
+
+// Recorder state; callers may trace from several threads at once
+static struct {
+    pthread_mutex_t lock;
+    FILE* file;
+    bool recording;                  // Read without the lock on every call
+    struct timespec epoch;
+    const void** ids;                // Index = trace id
+    size_t num_ids;
+    size_t capacity;
+} trace = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+
+static uint64_t elapsed_ns(const struct timespec* from, const struct timespec* to) {
+    return (uint64_t)(to->tv_sec - from->tv_sec) * 1000000000ull +
+           (uint64_t)to->tv_nsec - (uint64_t)from->tv_nsec;
+}
+
+static bool start_recording(const char* filename) {
+    pthread_mutex_lock(&trace.lock);
+    if (trace.file) fclose(trace.file);
+    trace.file = fopen(filename, "wb");
+    bool ok = trace.file && fwrite(TRACE_MAGIC, 8, 1, trace.file) == 1;
+    if (!ok) {
+        printf("trace: Cannot open %s\n", filename);
+        if (trace.file) fclose(trace.file);
+        trace.file = NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &trace.epoch);
+    trace.num_ids = 0;
+    __atomic_store_n(&trace.recording, ok, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace.lock);
+    return ok;
+}
+
+// SOUND_SEG_TRACE is honoured once, before the first call is traced
+static void check_env(void) {
+    const char* path = getenv("SOUND_SEG_TRACE");
+    if (path && *path) start_recording(path);
+}
+
+bool tr_trace_start(const char* filename) {
+    pthread_once(&env_once, check_env);
+    return start_recording(filename);
+}
+
+void tr_trace_stop(void) {
+    pthread_once(&env_once, check_env);
+    pthread_mutex_lock(&trace.lock);
+    __atomic_store_n(&trace.recording, false, __ATOMIC_RELEASE);
+    if (trace.file) fclose(trace.file);
+    trace.file = NULL;
+    free(trace.ids);
+    trace.ids = NULL;
+    trace.num_ids = 0;
+    trace.capacity = 0;
+    pthread_mutex_unlock(&trace.lock);
+}
+
+static bool active(void) {
+    pthread_once(&env_once, check_env);
+    return __atomic_load_n(&trace.recording, __ATOMIC_ACQUIRE);
+}
+
+// Map a track or session pointer to its trace id, assigning the next id
+// when new. A later object at the address of a destroyed one is given a
+// fresh id because forget_handle() cleared the old mapping.
+static uint32_t handle_id(const void* handle) {
+    if (!handle) return UINT32_MAX;
+    for (size_t i = trace.num_ids; i > 0; i--) {
+        if (trace.ids[i - 1] == handle) return (uint32_t)(i - 1);
+    }
+
+    if (trace.num_ids == trace.capacity) {
+        size_t capacity = trace.capacity ? trace.capacity * 2 : 64;
+        const void** grown = realloc(trace.ids, capacity * sizeof(*grown));
+        if (!grown) return UINT32_MAX;
+        trace.ids = grown;
+        trace.capacity = capacity;
+    }
+    trace.ids[trace.num_ids] = handle;
+    return (uint32_t)trace.num_ids++;
+}
+
+static void forget_handle(const void* handle) {
+    for (size_t i = trace.num_ids; i > 0; i--) {
+        if (trace.ids[i - 1] == handle) {
+            trace.ids[i - 1] = NULL;
+            return;
+        }
+    }
+}
+
+static void put(const void* data, size_t size) {
+    if (trace.file && fwrite(data, size, 1, trace.file) != 1) {
+        printf("trace: Write failed, tracing stopped\n");
+        __atomic_store_n(&trace.recording, false, __ATOMIC_RELEASE);
+        fclose(trace.file);
+        trace.file = NULL;
+    }
+}
+
+static void put_u8(uint8_t v) { put(&v, sizeof(v)); }
+static void put_u32(uint32_t v) { put(&v, sizeof(v)); }
+static void put_u64(uint64_t v) { put(&v, sizeof(v)); }
+static void put_handle(const void* handle) { put_u32(handle_id(handle)); }
+
+static void put_path(const char* path) {
+    uint32_t len = path ? (uint32_t)strlen(path) : 0;
+    put_u32(len);
+    if (len) put(path, len);
+}
+
+static void put_batch_options(const struct wav_batch_options* options) {
+    put_u64(options ? options->threads : 0);
+    put_u64(options ? options->max_inflight_bytes : 0);
+}
+
+// Write the fixed record prefix; the caller holds the lock and appends args
+static void begin_record(enum trace_op op, bool result,
+                         const struct timespec* start, const struct timespec* end) {
+    uint8_t prefix[2] = { (uint8_t)op, (uint8_t)result };
+    put(prefix, sizeof(prefix));
+    put_u64(elapsed_ns(&trace.epoch, start));
+    put_u64(elapsed_ns(start, end));
+}
+
+// Time a call only while tracing; the common case costs one branch
+#define TRACE_CALL(call)                                   \
+    struct timespec start_ts, end_ts;                      \
+    bool traced = active();                                \
+    if (traced) clock_gettime(CLOCK_MONOTONIC, &start_ts); \
+    call;                                                  \
+    if (traced) clock_gettime(CLOCK_MONOTONIC, &end_ts);   \
+    if (traced) pthread_mutex_lock(&trace.lock);           \
+    if (traced && !trace.file) {                           \
+        pthread_mutex_unlock(&trace.lock);                 \
+        traced = false;                                    \
+    }                                                      \
+    (void)0
+
+#define TRACE_END() \
+    if (traced) pthread_mutex_unlock(&trace.lock)
+
+int16_t* __wrap_wav_load(const char* filename, size_t* length) {
+    int16_t* result;
+    TRACE_CALL(result = __real_wav_load(filename, length));
+    if (traced) {
+        begin_record(TRACE_OP_WAV_LOAD, result != NULL, &start_ts, &end_ts);
+        put_path(filename);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_wav_save(const char* filename, int16_t* samples, size_t length) {
+    bool result;
+    TRACE_CALL(result = __real_wav_save(filename, samples, length));
+    if (traced) {
+        begin_record(TRACE_OP_WAV_SAVE, result, &start_ts, &end_ts);
+        put_path(filename);
+        put_u64(length);
+    }
+    TRACE_END();
+    return result;
+}
+
+struct sound_seg* __wrap_tr_init(void) {
+    struct sound_seg* result;
+    TRACE_CALL(result = __real_tr_init());
+    if (traced) {
+        // A new track at a recycled address must not inherit an old id
+        forget_handle(result);
+        begin_record(TRACE_OP_INIT, result != NULL, &start_ts, &end_ts);
+        put_handle(result);
+    }
+    TRACE_END();
+    return result;
+}
+
+void __wrap_tr_destroy(struct sound_seg* track) {
+    TRACE_CALL(__real_tr_destroy(track));
+    if (traced) {
+        begin_record(TRACE_OP_DESTROY, true, &start_ts, &end_ts);
+        put_handle(track);
+        forget_handle(track);
+    }
+    TRACE_END();
+}
+
+size_t __wrap_tr_length(struct sound_seg* track) {
+    size_t result;
+    TRACE_CALL(result = __real_tr_length(track));
+    if (traced) {
+        begin_record(TRACE_OP_LENGTH, true, &start_ts, &end_ts);
+        put_handle(track);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_read(struct sound_seg* track, size_t pos, size_t len, int16_t* buffer) {
+    bool result;
+    TRACE_CALL(result = __real_tr_read(track, pos, len, buffer));
+    if (traced) {
+        begin_record(TRACE_OP_READ, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(pos);
+        put_u64(len);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_write(struct sound_seg* track, size_t pos, size_t len, const int16_t* buffer) {
+    bool result;
+    TRACE_CALL(result = __real_tr_write(track, pos, len, buffer));
+    if (traced) {
+        // The samples are recorded so replay reproduces dedup and sharing
+        begin_record(TRACE_OP_WRITE, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(pos);
+        put_u64(buffer ? len : 0);
+        if (buffer && len) put(buffer, len * sizeof(int16_t));
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_delete_range(struct sound_seg* track, size_t pos, size_t len) {
+    bool result;
+    TRACE_CALL(result = __real_tr_delete_range(track, pos, len));
+    if (traced) {
+        begin_record(TRACE_OP_DELETE, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(pos);
+        put_u64(len);
+    }
+    TRACE_END();
+    return result;
+}
+
+char* __wrap_tr_identify(struct sound_seg* target, struct sound_seg* ad) {
+    char* result;
+    TRACE_CALL(result = __real_tr_identify(target, ad));
+    if (traced) {
+        begin_record(TRACE_OP_IDENTIFY, result != NULL, &start_ts, &end_ts);
+        put_handle(target);
+        put_handle(ad);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_identify_each(struct sound_seg* target, struct sound_seg* ad,
+                             tr_match_fn on_match, void* context) {
+    bool result;
+    TRACE_CALL(result = __real_tr_identify_each(target, ad, on_match, context));
+    if (traced) {
+        begin_record(TRACE_OP_IDENTIFY_EACH, result, &start_ts, &end_ts);
+        put_handle(target);
+        put_handle(ad);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_insert(struct sound_seg* dest_track, size_t destpos,
+                      struct sound_seg* src_track, size_t srcpos, size_t len) {
+    bool result;
+    TRACE_CALL(result = __real_tr_insert(dest_track, destpos, src_track, srcpos, len));
+    if (traced) {
+        begin_record(TRACE_OP_INSERT, result, &start_ts, &end_ts);
+        put_handle(dest_track);
+        put_u64(destpos);
+        put_handle(src_track);
+        put_u64(srcpos);
+        put_u64(len);
+    }
+    TRACE_END();
+    return result;
+}
+
+void __wrap_tr_resolve(struct sound_seg** tracks, size_t num_tracks) {
+    TRACE_CALL(__real_tr_resolve(tracks, num_tracks));
+    if (traced) {
+        begin_record(TRACE_OP_RESOLVE, true, &start_ts, &end_ts);
+        put_u32(tracks ? (uint32_t)num_tracks : 0);
+        for (size_t i = 0; tracks && i < num_tracks; i++) {
+            put_handle(tracks[i]);
+        }
+    }
+    TRACE_END();
+}
+
+bool __wrap_tr_fill(struct sound_seg* track, size_t pos, size_t len, int16_t value) {
+    bool result;
+    TRACE_CALL(result = __real_tr_fill(track, pos, len, value));
+    if (traced) {
+        begin_record(TRACE_OP_FILL, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(pos);
+        put_u64(len);
+        put(&value, sizeof(value));
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_insert_silence(struct sound_seg* track, size_t pos, size_t len) {
+    bool result;
+    TRACE_CALL(result = __real_tr_insert_silence(track, pos, len));
+    if (traced) {
+        begin_record(TRACE_OP_SILENCE, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(pos);
+        put_u64(len);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_load_wav(struct sound_seg* track, const char* filename) {
+    bool result;
+    TRACE_CALL(result = __real_tr_load_wav(track, filename));
+    if (traced) {
+        begin_record(TRACE_OP_LOAD_WAV, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_path(filename);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_tr_save_wav(struct sound_seg* track, const char* filename) {
+    bool result;
+    TRACE_CALL(result = __real_tr_save_wav(track, filename));
+    if (traced) {
+        begin_record(TRACE_OP_SAVE_WAV, result, &start_ts, &end_ts);
+        put_handle(track);
+        put_path(filename);
+    }
+    TRACE_END();
+    return result;
+}
+
+struct identify_session* __wrap_tr_identify_begin(struct sound_seg* target) {
+    struct identify_session* result;
+    TRACE_CALL(result = __real_tr_identify_begin(target));
+    if (traced) {
+        forget_handle(result);
+        begin_record(TRACE_OP_SESSION_BEGIN, result != NULL, &start_ts, &end_ts);
+        put_handle(result);
+        put_handle(target);
+    }
+    TRACE_END();
+    return result;
+}
+
+char* __wrap_tr_identify_refresh(struct identify_session* session, struct sound_seg* ad) {
+    char* result;
+    TRACE_CALL(result = __real_tr_identify_refresh(session, ad));
+    if (traced) {
+        begin_record(TRACE_OP_SESSION_REFRESH, result != NULL, &start_ts, &end_ts);
+        put_handle(session);
+        put_handle(ad);
+    }
+    TRACE_END();
+    return result;
+}
+
+void __wrap_tr_identify_end(struct identify_session* session) {
+    TRACE_CALL(__real_tr_identify_end(session));
+    if (traced) {
+        begin_record(TRACE_OP_SESSION_END, true, &start_ts, &end_ts);
+        put_handle(session);
+        forget_handle(session);
+    }
+    TRACE_END();
+}
+
+bool __wrap_tr_pager_configure(const char* spill_path, size_t budget_bytes,
+                               size_t prefetch_samples) {
+    bool result;
+    TRACE_CALL(result = __real_tr_pager_configure(spill_path, budget_bytes, prefetch_samples));
+    if (traced) {
+        begin_record(TRACE_OP_PAGER_CONFIGURE, result, &start_ts, &end_ts);
+        put_path(spill_path);
+        put_u64(budget_bytes);
+        put_u64(prefetch_samples);
+    }
+    TRACE_END();
+    return result;
+}
+
+void __wrap_tr_pager_stats(struct tr_pager_stats* stats) {
+    TRACE_CALL(__real_tr_pager_stats(stats));
+    if (traced) begin_record(TRACE_OP_PAGER_STATS, true, &start_ts, &end_ts);
+    TRACE_END();
+}
+
+void __wrap_tr_dedup_configure(bool enabled, size_t block_samples) {
+    TRACE_CALL(__real_tr_dedup_configure(enabled, block_samples));
+    if (traced) {
+        begin_record(TRACE_OP_DEDUP_CONFIGURE, true, &start_ts, &end_ts);
+        put_u8(enabled);
+        put_u64(block_samples);
+    }
+    TRACE_END();
+}
+
+void __wrap_tr_dedup_stats(struct tr_dedup_stats* stats) {
+    TRACE_CALL(__real_tr_dedup_stats(stats));
+    if (traced) begin_record(TRACE_OP_DEDUP_STATS, true, &start_ts, &end_ts);
+    TRACE_END();
+}
+
+void __wrap_tr_set_budget(struct sound_seg* track, size_t budget_bytes) {
+    TRACE_CALL(__real_tr_set_budget(track, budget_bytes));
+    if (traced) {
+        begin_record(TRACE_OP_SET_BUDGET, true, &start_ts, &end_ts);
+        put_handle(track);
+        put_u64(budget_bytes);
+    }
+    TRACE_END();
+}
+
+void __wrap_tr_set_global_budget(size_t budget_bytes) {
+    TRACE_CALL(__real_tr_set_global_budget(budget_bytes));
+    if (traced) {
+        begin_record(TRACE_OP_SET_GLOBAL_BUDGET, true, &start_ts, &end_ts);
+        put_u64(budget_bytes);
+    }
+    TRACE_END();
+}
+
+void __wrap_tr_set_budget_hook(tr_budget_hook hook, void* user_data) {
+    TRACE_CALL(__real_tr_set_budget_hook(hook, user_data));
+    if (traced) {
+        begin_record(TRACE_OP_SET_BUDGET_HOOK, true, &start_ts, &end_ts);
+        put_u8(hook != NULL);
+    }
+    TRACE_END();
+}
+
+bool __wrap_tr_memory_usage(struct sound_seg* track, struct tr_memory_usage* usage) {
+    bool result;
+    TRACE_CALL(result = __real_tr_memory_usage(track, usage));
+    if (traced) {
+        begin_record(TRACE_OP_MEMORY_USAGE, result, &start_ts, &end_ts);
+        put_handle(track);
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_proj_save(const char* filename, struct sound_seg** tracks, size_t num_tracks) {
+    bool result;
+    TRACE_CALL(result = __real_proj_save(filename, tracks, num_tracks));
+    if (traced) {
+        begin_record(TRACE_OP_PROJ_SAVE, result, &start_ts, &end_ts);
+        put_path(filename);
+        put_u32(tracks ? (uint32_t)num_tracks : 0);
+        for (size_t i = 0; tracks && i < num_tracks; i++) {
+            put_handle(tracks[i]);
+        }
+    }
+    TRACE_END();
+    return result;
+}
+
+struct sound_project* __wrap_proj_open(const char* filename) {
+    struct sound_project* result;
+    TRACE_CALL(result = __real_proj_open(filename));
+    if (traced) {
+        forget_handle(result);
+        begin_record(TRACE_OP_PROJ_OPEN, result != NULL, &start_ts, &end_ts);
+        put_handle(result);
+        put_path(filename);
+    }
+    TRACE_END();
+    return result;
+}
+
+size_t __wrap_proj_track_count(struct sound_project* project) {
+    size_t result;
+    TRACE_CALL(result = __real_proj_track_count(project));
+    if (traced) {
+        begin_record(TRACE_OP_PROJ_TRACK_COUNT, true, &start_ts, &end_ts);
+        put_handle(project);
+    }
+    TRACE_END();
+    return result;
+}
+
+// A track is handed out once and then keeps its id across repeated calls
+struct sound_seg* __wrap_proj_track(struct sound_project* project, size_t index) {
+    struct sound_seg* result;
+    TRACE_CALL(result = __real_proj_track(project, index));
+    if (traced) {
+        begin_record(TRACE_OP_PROJ_TRACK, result != NULL, &start_ts, &end_ts);
+        put_handle(project);
+        put_u64(index);
+        put_handle(result);
+    }
+    TRACE_END();
+    return result;
+}
+
+void __wrap_proj_close(struct sound_project* project) {
+    TRACE_CALL(__real_proj_close(project));
+    if (traced) {
+        begin_record(TRACE_OP_PROJ_CLOSE, true, &start_ts, &end_ts);
+        put_handle(project);
+        forget_handle(project);
+    }
+    TRACE_END();
+}
+
+bool __wrap_wav_load_batch(const char** filenames, size_t count,
+                           const struct wav_batch_options* options,
+                           struct wav_batch_result* results) {
+    bool result;
+    TRACE_CALL(result = __real_wav_load_batch(filenames, count, options, results));
+    if (traced) {
+        bool listed = filenames && results;
+        begin_record(TRACE_OP_LOAD_BATCH, result, &start_ts, &end_ts);
+        put_u32(listed ? (uint32_t)count : 0);
+        put_batch_options(options);
+        for (size_t i = 0; listed && i < count; i++) {
+            struct sound_seg* track = results[i].ok ? results[i].track : NULL;
+            forget_handle(track);
+            put_path(filenames[i]);
+            put_u8(results[i].ok);
+            put_handle(track);
+        }
+    }
+    TRACE_END();
+    return result;
+}
+
+bool __wrap_wav_save_batch(const char** filenames, struct sound_seg** tracks, size_t count,
+                           const struct wav_batch_options* options,
+                           struct wav_batch_result* results) {
+    bool result;
+    TRACE_CALL(result = __real_wav_save_batch(filenames, tracks, count, options, results));
+    if (traced) {
+        bool listed = filenames && tracks;
+        begin_record(TRACE_OP_SAVE_BATCH, result, &start_ts, &end_ts);
+        put_u32(listed ? (uint32_t)count : 0);
+        put_batch_options(options);
+        for (size_t i = 0; listed && i < count; i++) {
+            put_path(filenames[i]);
+            put_handle(tracks[i]);
+        }
+    }
+    TRACE_END();
+    return result;
+}
@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Operation tracing. Built with `make TRACE=1`, the public API in
+// sound_seg.h is wrapped at link time (-Wl,--wrap) so every call made from
+// outside the library is recorded with its arguments, result and duration.
+// The library objects are first combined with `ld -r`; --wrap only rewrites
+// undefined references, so calls between library sources (batch ingest
+// building tracks, proj_track creating them) reach the real functions and
+// are not recorded a second time. Recording starts on the first traced call
+// when SOUND_SEG_TRACE names an output file, or explicitly with
+// tr_trace_start(). tr_node_samples() is not wrapped: nodes have no trace
+// ids, and it only faults samples in without changing any track.
+//
+// Trace format (native byte order, fields packed):
+//
+//   header  := "SSTRACE2"  ("SSTRACE1" traces hold only ops up to SILENCE)
+//   record  := uint8 op, uint8 result, uint64 start_ns, uint64 duration_ns,
+//              arguments
+//
+// Tracks, identify sessions and projects are identified by uint32 ids
+// assigned the first time a pointer is seen, NULL as UINT32_MAX. Arguments
+// per op (pos/len/length/bytes are uint64, paths are uint32 length + bytes,
+// flags are uint8):
+//
+//   INIT      id                  DESTROY   id
+//   LENGTH    id                  READ      id, pos, len
+//   WRITE     id, pos, len, len int16 samples
+//   DELETE    id, pos, len        IDENTIFY  target id, ad id
+//   IDENTIFY_EACH  target id, ad id
+//   FILL      id, pos, len, int16 value
+//   SILENCE   id, pos, len
+//   INSERT    dest, destpos, src, srcpos, len
+//   RESOLVE   uint32 n, n ids
+//   WAV_LOAD  path                WAV_SAVE  path, length
+//   LOAD_WAV  id, path            SAVE_WAV  id, path
+//   SESSION_BEGIN    session id, target id
+//   SESSION_REFRESH  session id, ad id
+//   SESSION_END      session id
+//   PAGER_CONFIGURE  spill path (empty = NULL), budget bytes, prefetch samples
+//   PAGER_STATS      (none)         DEDUP_STATS  (none)
+//   DEDUP_CONFIGURE  flag enabled, block samples
+//   SET_BUDGET       id, bytes      SET_GLOBAL_BUDGET  bytes
+//   SET_BUDGET_HOOK  flag installed (the hook itself cannot be recorded)
+//   MEMORY_USAGE     id
+//   PROJ_SAVE        path, uint32 n, n ids
+//   PROJ_OPEN        project id, path
+//   PROJ_TRACK       project id, index, track id
+//   PROJ_TRACK_COUNT project id     PROJ_CLOSE   project id
+//   LOAD_BATCH       uint32 n, threads, max inflight bytes,
+//                    n * (path, flag ok, track id)
+//   SAVE_BATCH       uint32 n, threads, max inflight bytes, n * (path, id)
+
+#define TRACE_MAGIC "SSTRACE2"
+#define TRACE_MAGIC_V1 "SSTRACE1"
+
+enum trace_op {
+    TRACE_OP_INIT = 1,
+    TRACE_OP_DESTROY,
+    TRACE_OP_LENGTH,
+    TRACE_OP_READ,
+    TRACE_OP_WRITE,
+    TRACE_OP_DELETE,
+    TRACE_OP_IDENTIFY,
+    TRACE_OP_INSERT,
+    TRACE_OP_RESOLVE,
+    TRACE_OP_WAV_LOAD,
+    TRACE_OP_WAV_SAVE,
+    TRACE_OP_LOAD_WAV,
+    TRACE_OP_SAVE_WAV,
+    TRACE_OP_SESSION_BEGIN,
+    TRACE_OP_SESSION_REFRESH,
+    TRACE_OP_SESSION_END,
+    TRACE_OP_IDENTIFY_EACH,
+    TRACE_OP_FILL,
+    TRACE_OP_SILENCE,
+    TRACE_OP_PAGER_CONFIGURE,
+    TRACE_OP_PAGER_STATS,
+    TRACE_OP_DEDUP_CONFIGURE,
+    TRACE_OP_DEDUP_STATS,
+    TRACE_OP_SET_BUDGET,
+    TRACE_OP_SET_GLOBAL_BUDGET,
+    TRACE_OP_SET_BUDGET_HOOK,
+    TRACE_OP_MEMORY_USAGE,
+    TRACE_OP_PROJ_SAVE,
+    TRACE_OP_PROJ_OPEN,
+    TRACE_OP_PROJ_TRACK,
+    TRACE_OP_PROJ_TRACK_COUNT,
+    TRACE_OP_PROJ_CLOSE,
+    TRACE_OP_LOAD_BATCH,
+    TRACE_OP_SAVE_BATCH,
+    TRACE_OP_COUNT
+};
+
+bool tr_trace_start(const char* filename);
+void tr_trace_stop(void);
+
+#endif // TRACE_H